@@ -10,7 +10,6 @@ public:
 	PLRUtree(){}
 	PLRUtree(int size) :size(size){}
 	~PLRUtree(){}
-	uint32_t addresses[16];
 	bool binaryTree[16];
 
 	uint32_t getOverwriteTarget()
@@ -48,5 +47,44 @@ public:
 		binaryTree[t] = element < t;
 	}
 
+	// setPath, returning how close element was to eviction before the update: 0 if every node on its
+	// path pointed away from it, size - 1 if it was the overwrite target
+	uint32_t touch(uint32_t element)
+	{
+		uint32_t s = size / 2;
+		uint32_t t = s;
+		uint32_t position = 0;
+		while (s > 1)
+		{
+			s /= 2;
+			bool right = element >= t;
+			position = (position << 1) | (binaryTree[t] == right);
+			binaryTree[t] = !right;
+			if (right)
+				t += s;
+			else
+				t -= s;
+		}
+		bool right = element >= t;
+		position = (position << 1) | (binaryTree[t] == right);
+		binaryTree[t] = !right;
+		return position;
+	}
+
+	// tree state packed into bits, bit i holds node i
+	uint32_t getBits() const
+	{
+		uint32_t bits = 0;
+		for (int i = 1; i < size; ++i)
+			bits |= (uint32_t)binaryTree[i] << i;
+		return bits;
+	}
+
+	void setBits(uint32_t bits)
+	{
+		for (int i = 1; i < size; ++i)
+			binaryTree[i] = (bits >> i) & 1;
+	}
+
 };
 
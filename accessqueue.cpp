@@ -0,0 +1,111 @@
+#include "accessqueue.h"
+
+thread_local AccessRing* AccessQueues::ring = nullptr;
+
+void AccessQueues::Start(QueueOrder o, void (*s)(const QueuedAccess&))
+{
+	Stop();
+	order = o;
+	simulate = s;
+	stopping.store(false, std::memory_order_relaxed);
+	drainer = std::thread(&AccessQueues::Drain, this);
+	running = true;
+}
+
+void AccessQueues::Stop()
+{
+	if (!drainer.joinable())
+		return;
+	stopping.store(true, std::memory_order_release);
+	drainer.join(); // the simulator thread only stops once every ring is empty
+	running = false;
+}
+
+void AccessQueues::Flush()
+{
+	if (!drainer.joinable())
+		return;
+	while (!AllEmpty())
+		std::this_thread::yield();
+}
+
+AccessRing* AccessQueues::Register()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	rings.emplace_back(new AccessRing());
+	registered.store(rings.size(), std::memory_order_release);
+	return rings.back().get();
+}
+
+bool AccessQueues::AllEmpty()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	for (const std::unique_ptr<AccessRing>& r : rings)
+		if (!r->Empty())
+			return false;
+	return true;
+}
+
+// the simulator thread: drains the rings until stopped and every ring is empty
+void AccessQueues::Drain()
+{
+	std::vector<AccessRing*> active; // copy of rings, so registering does not wait for the simulator
+	while (true)
+	{
+		bool stop = stopping.load(std::memory_order_acquire);
+		if (active.size() != registered.load(std::memory_order_acquire))
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			active.clear();
+			for (const std::unique_ptr<AccessRing>& r : rings)
+				active.push_back(r.get());
+		}
+		bool drained = order == QUEUETIMESTAMP ? DrainByStamp(active) : DrainRoundRobin(active);
+		if (drained)
+			continue;
+		if (stop && active.size() == registered.load(std::memory_order_acquire))
+			return; // nothing left that was pushed before Stop
+		std::this_thread::yield();
+	}
+}
+
+bool AccessQueues::DrainRoundRobin(const std::vector<AccessRing*>& active)
+{
+	bool drained = false;
+	for (AccessRing* r : active)
+	{
+		const QueuedAccess* a;
+		for (int n = 0; n < QUEUEQUANTUM && (a = r->Front()) != nullptr; ++n)
+		{
+			simulate(*a);
+			r->Pop();
+			drained = true;
+		}
+	}
+	return drained;
+}
+
+// Oldest first by time stamp, as far as the rings show: a thread that has not pushed its access yet
+// can not be waited for, so accesses are only ordered among those already queued.
+bool AccessQueues::DrainByStamp(const std::vector<AccessRing*>& active)
+{
+	std::vector<int> quantum(active.size(), QUEUEQUANTUM);
+	bool drained = false;
+	while (true)
+	{
+		int oldest = -1;
+		const QueuedAccess* first = nullptr;
+		for (std::size_t i = 0; i < active.size(); ++i)
+		{
+			const QueuedAccess* a = quantum[i] > 0 ? active[i]->Front() : nullptr;
+			if (a != nullptr && (first == nullptr || a->stamp < first->stamp))
+				oldest = (int)i, first = a;
+		}
+		if (first == nullptr)
+			return drained;
+		simulate(*first);
+		active[oldest]->Pop();
+		quantum[oldest]--;
+		drained = true;
+	}
+}
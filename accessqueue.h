@@ -0,0 +1,82 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "simprofile.h"
+#include "spscring.h"
+
+// Per-thread access queues (SIMQUEUES in simconfig.h): READ and WRITE do the access on host memory and
+// push a record into a ring of their own thread instead of simulating it, and a simulator thread drains
+// the rings into the hierarchy. Application threads only wait when their ring is full, so several of
+// them can use the simulator at once and the simulation overlaps with the workload.
+// The workload reads and writes host memory directly then, so host memory holds the data and simulated
+// memory only follows it: the simulated memory cannot start from a checkpoint (sim.h rejects
+// LOADCHECKPOINT with SIMQUEUES) and every queued address must be real host memory.
+
+#define QUEUECAPACITY 4096 // accesses per ring, a power of 2
+#define QUEUEQUANTUM 256 // accesses the simulator takes from one ring before it looks at the others
+
+enum QueueOrder
+{
+	QUEUEROUNDROBIN, // a quantum of every ring in turn
+	QUEUETIMESTAMP // oldest first over the rings, at most a quantum per ring per round
+};
+
+struct QueuedAccess
+{
+	std::uintptr_t address;
+	std::uint64_t value; // the bytes written, copied to the start
+	std::uint64_t stamp; // time stamp counter when it was pushed
+	std::uint32_t size, write;
+};
+
+// the ring of one application thread, the simulator thread pops the accesses once simulated
+typedef SpscRing<QueuedAccess, QUEUECAPACITY> AccessRing;
+
+// The rings of every thread that accessed simulated memory and the thread draining them. A ring is made
+// on the first access of a thread and lives as long as the queues, so threads may come and go.
+class AccessQueues
+{
+public:
+	bool running = false; // READ and WRITE push instead of simulating, only changed while no workload runs
+
+	~AccessQueues() { Stop(); }
+
+	// start the simulator thread, it hands every access to simulate
+	void Start(QueueOrder order, void (*simulate)(const QueuedAccess&));
+
+	// wait until every access pushed so far is simulated, then stop the simulator thread
+	void Stop();
+
+	// wait until every access pushed so far is simulated
+	void Flush();
+
+	void Push(std::uintptr_t address, std::uint32_t size, bool write, std::uint64_t value)
+	{
+		AccessRing* r = ring;
+		if (r == nullptr)
+			r = ring = Register();
+		QueuedAccess a = { address, value, ProfileStamp(), size, write ? 1u : 0u };
+		while (!r->Push(a)) // the simulator is behind, let it catch up
+			std::this_thread::yield();
+	}
+
+private:
+	static thread_local AccessRing* ring; // of the calling thread
+	std::mutex lock; // guards rings
+	std::vector<std::unique_ptr<AccessRing>> rings;
+	std::atomic<std::size_t> registered{ 0 };
+	std::atomic<bool> stopping{ false };
+	std::thread drainer;
+	QueueOrder order = QUEUEROUNDROBIN;
+	void (*simulate)(const QueuedAccess&) = nullptr;
+
+	AccessRing* Register();
+	bool AllEmpty();
+	void Drain();
+	bool DrainRoundRobin(const std::vector<AccessRing*>& active);
+	bool DrainByStamp(const std::vector<AccessRing*>& active);
+};
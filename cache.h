@@ -1,18 +1,32 @@
 #include <stdio.h>
 #include <iomanip>
+#include <iostream>
+#include <math.h>
+#include <stddef.h>
+#include "simconfig.h"
 #include "PLRUtree.h"
+#include "simmemory.h"
+#include "checkpoint.h"
+#include "simprofile.h"
+#include <vector>
+#ifdef CLASSIFYMISSES
+#include <unordered_set>
+#include <unordered_map>
+#endif
 #define CYCLESPERMILLISECOND 3500000
 
 #pragma once
 
 #define LINESIZE 64
+#define CHECKPOINTCACHE 1 // kinds of level in a checkpoint
+#define CHECKPOINTDRAM 2
 
 struct CacheLine
 {
 	std::uintptr_t tag;
-	byte data[LINESIZE];
-	bool valid, dirty;
+	bool valid, dirty; // next to the tag, so looking a line up does not touch its data
 	int set; // the set this cache line is stored in
+	byte data[LINESIZE];
 
 	CacheLine() { }
 
@@ -22,54 +36,274 @@ struct CacheLine
 		valid = cl.valid;
 		dirty = cl.dirty;
 		set = cl.set;
-
-		for (int i = 0; i < LINESIZE; ++i)
-			data[i] = cl.data[i];
+		memcpy(data, cl.data, LINESIZE);
 	}
 
 	CacheLine(std::uintptr_t tag, byte* data, bool valid, bool dirty)
 		: tag(tag), valid(valid), dirty(dirty)
 	{
-		for (int i = 0; i < LINESIZE; ++i)
-			this->data[i] = data[i];
+		memcpy(this->data, data, LINESIZE);
 	}
 };
 
+// Replacement state and counters of one set together, so a hit only touches the record of its own
+// set: the level totals are summed from these when they are needed, see CacheBase::Tally. A set starts
+// a host cache line, which holds all a read hit close to the most recently used position touches.
+struct alignas(64) CacheSet
+{
+	PLRUtree tree;
+	std::uint64_t reads;
+	std::uint64_t hits[16]; // hits per PLRU position, 0 is most recently used (a PLRUtree has at most 16 ways)
+	std::uint64_t writes, readmisses, writemisses;
+
+	std::uint64_t Accesses() const { return reads + writes; }
+	std::uint64_t Misses() const { return readmisses + writemisses; }
+};
+static_assert(offsetof(CacheSet, hits) + 4 * sizeof(std::uint64_t) <= 64, "the tree, reads and the first hit positions share a line");
+
+#ifdef CLASSIFYMISSES
+enum MissKind { COMPULSORY, CAPACITY, CONFLICT };
+
+// Sorts misses into compulsory (first touch of the line), capacity (the line also misses in a
+// fully associative LRU cache of the same size) and conflict (the line hits in that shadow cache).
+class MissClassifier
+{
+public:
+	MissClassifier(int lines) : nodes(lines) { lookup.reserve(lines); }
+
+	// update with an access to line, returns the kind of miss this is if the real cache missed
+	MissKind Access(std::uintptr_t line)
+	{
+		bool first = seen.insert(line).second;
+
+		std::unordered_map<std::uintptr_t, int>::iterator it = lookup.find(line);
+		if (it != lookup.end()) // shadow hit, move to the front
+		{
+			Unlink(it->second);
+			PushFront(it->second);
+			return first ? COMPULSORY : CONFLICT;
+		}
+
+		int node;
+		if (used < (int)nodes.size())
+			node = used++;
+		else // shadow miss in a full cache, reuse the least recently used node
+		{
+			node = tail;
+			Unlink(node);
+			lookup.erase(nodes[node].line);
+		}
+
+		nodes[node].line = line;
+		lookup[line] = node;
+		PushFront(node);
+		return first ? COMPULSORY : CAPACITY;
+	}
+
+private:
+	struct Node
+	{
+		std::uintptr_t line;
+		int prev, next;
+	};
+
+	std::unordered_set<std::uintptr_t> seen; // every line ever touched
+	std::unordered_map<std::uintptr_t, int> lookup; // line to node in the shadow cache
+	std::vector<Node> nodes; // intrusive LRU list, head is most recently used
+	int head = -1, tail = -1, used = 0;
+
+	void Unlink(int node)
+	{
+		Node& n = nodes[node];
+		if (n.prev != -1) nodes[n.prev].next = n.next; else head = n.next;
+		if (n.next != -1) nodes[n.next].prev = n.prev; else tail = n.prev;
+	}
+
+	void PushFront(int node)
+	{
+		nodes[node].prev = -1;
+		nodes[node].next = head;
+		if (head != -1) nodes[head].prev = node; else tail = node;
+		head = node;
+	}
+};
+#endif
+
 // base class with public interface for access between cache levels
 class CacheBase
 {
 public:
-	int reads = 0, writes = 0, writemisses = 0, readmisses = 0, evicts = 0; // counters for stats
+	std::uint64_t reads = 0, writes = 0, writemisses = 0, readmisses = 0; // counters for stats, see Tally
+	std::uint64_t cleanevicts = 0, dirtyevicts = 0; // replaced lines, dirty ones were written back
+#ifdef CLASSIFYMISSES
+	std::uint64_t misses3C[3] = {}; // misses per MissKind
+#endif
+#ifdef SIMPROFILE
+	PhaseProfile phases; // where the simulator spends its time in this level
+#endif
 	int latency = 0;
 	int offsetBits = 0, indexBits = 0; // number of bits in offset and index for this cache
+	int sets = 0, ways = 0; // geometry, 0 for levels that are not set associative
+	SimMemory* memory = SimMemory::GetMemory(); // backing memory when this is the last level
+	int sampleShift = 0; // only 1 in 2^sampleShift sets is simulated
+	std::uintptr_t sampleMask = 0; // address bits that must be 0 for the line to be in a sampled set
+	std::uint64_t skipped = 0; // accesses to sets that were not sampled
+	int depth = 0; // 1 for the first level, 2 for the one below it and so on, see MissDepth
+
+	// Deepest level the current access missed in on demand: a detailed demand miss stores its depth here
+	// before going down, so a miss further down overwrites it. Write backs leave it alone. Clear it before
+	// the access.
+	static int& MissDepth()
+	{
+		static int missDepth = 0;
+		return missDepth;
+	}
+
+	// Time of the requester in core cycles: every detailed access adds the latency of the level it
+	// reaches, so it runs along with SimCycles. The DRAM model stamps the arrival of its requests with it.
+	static std::uint64_t& Clock()
+	{
+		static std::uint64_t clock = 0;
+		return clock;
+	}
+
+	// bring reads, writes, readmisses and writemisses up to date, for levels that count per set.
+	// Call it before reading them.
+	virtual void Tally() { }
 
 	virtual byte* ReadData(std::uintptr_t address) = 0;
 	virtual void WriteData(std::uintptr_t address, int nrOfBytes, byte* data) = 0;
 
+	// functional warming: same as ReadData and WriteData, but only the cache contents and
+	// replacement state are updated, no counters or timing
+	virtual byte* WarmData(std::uintptr_t address) = 0;
+	virtual void WarmWrite(std::uintptr_t address, int nrOfBytes, byte* data) = 0;
+
+	// Tag-only warming, for fast-forwarding traces: find the tag, update the PLRU tree, pick the victim and
+	// set the valid and dirty bits, the same way WarmData and WarmWrite do, and pass fills and write backs
+	// on as tags to the level below. No data is copied, nothing reaches SimMemory and no counter changes,
+	// so lines hold stale values afterwards, which traces never look at. Not virtual, it works on the
+	// arrays a Cache hands out in rows and setState.
+	void WarmTag(std::uintptr_t address, bool write)
+	{
+		if (rows == nullptr || (address & sampleMask)) // memory, or a set that is not sampled
+			return;
+#ifdef CLASSIFYMISSES
+		shadow->Access(address >> offsetBits);
+#endif
+
+		std::uintptr_t index = (address >> offsetBits) & (sets - 1), tag = address >> (offsetBits + indexBits);
+		CacheLine* row = rows + index * ways;
+		int way = 0;
+		while (way < ways && !(row[way].valid && row[way].tag == tag))
+			way++;
+		if (way == ways) // miss: fetch from below before evicting, like LoadData
+		{
+			if (below != nullptr)
+				below->WarmTag(address, false);
+			way = 0;
+			while (way < ways && row[way].valid)
+				way++;
+			if (way == ways)
+			{
+				way = setState[index].tree.getOverwriteTarget();
+				if (row[way].dirty && below != nullptr)
+					below->WarmTag((row[way].tag << (offsetBits + indexBits)) + (index << offsetBits), true);
+			}
+			row[way].tag = tag;
+			row[way].valid = true;
+			row[way].dirty = false;
+			row[way].set = way;
+		}
+		setState[index].tree.setPath(way);
+		if (write)
+			row[way].dirty = true;
+	}
+
+	// simulate only the sets whose lowest shift index bits are 0, in this level and the ones below it.
+	// Every level uses the same bits, so a line in a skipped set never enters any level.
+	virtual void SetSampling(int shift)
+	{
+		sampleShift = shift;
+		sampleMask = ((std::uintptr_t(1) << shift) - 1) << offsetBits;
+	}
+
+	// valid and dirty lines in every set, for visualization
+	virtual void Occupancy(std::uint16_t* valid, std::uint16_t* dirty) const { }
+
+	// write back dirty lines down to memory and leave this level and the ones below it empty
+	virtual void Flush() { }
+
+	// zero every counter, the contents stay as they are
+	virtual void ResetStats()
+	{
+		reads = writes = writemisses = readmisses = cleanevicts = dirtyevicts = skipped = 0;
+#ifdef CLASSIFYMISSES
+		misses3C[COMPULSORY] = misses3C[CAPACITY] = misses3C[CONFLICT] = 0;
+#endif
+#ifdef SIMPROFILE
+		phases.Reset();
+#endif
+	}
+
+	// write contents and replacement state to a checkpoint, see Checkpoint
+	virtual void Save(CheckpointWriter& out, bool data) = 0;
+
+	// read the state back from a checkpoint, only checking that it fits this level if apply is false
+	virtual bool Load(CheckpointReader& in, bool apply) = 0;
+
 	void PrintStats()
 	{
 		std::cout << "Reads: " << reads << std::endl;
 		std::cout << "Read misses: " << readmisses << std::endl;
 		std::cout << "Writes: " << writes << std::endl;
 		std::cout << "Write misses: " << writemisses << std::endl;
-		std::cout << "Evictions: " << evicts << std::endl;
+		std::cout << "Clean evictions: " << cleanevicts << std::endl;
+		std::cout << "Dirty evictions: " << dirtyevicts << std::endl;
+#ifdef CLASSIFYMISSES
+		std::cout << "Compulsory misses: " << misses3C[COMPULSORY] << std::endl;
+		std::cout << "Capacity misses: " << misses3C[CAPACITY] << std::endl;
+		std::cout << "Conflict misses: " << misses3C[CONFLICT] << std::endl;
+#endif
 		std::uint64_t cycles = (reads + writes) * latency;
 		std::cout << "Total cycles: " << cycles << " (" << cycles / CYCLESPERMILLISECOND << "ms)" << std::endl;
 	}
+
+protected:
+	CacheLine* rows = nullptr; // sets rows of ways lines for WarmTag, nullptr for levels without any
+	CacheSet* setState = nullptr; // per set
+#ifdef CLASSIFYMISSES
+	MissClassifier* shadow = nullptr; // the classifier of a Cache, warmed by WarmTag as well
+#endif
+	CacheBase* below = nullptr; // the next level, nullptr if it is memory
 };
 
 template<std::uint32_t size, std::uint32_t assoc>
 class Cache : public CacheBase
 {
 public:
-	Cache(CacheBase* nl = nullptr, const int l = 0)
+	// d is the depth of the level in its hierarchy, see MissDepth
+	Cache(CacheBase* nl = nullptr, const int l = 0, const int d = 0)
+#ifdef CLASSIFYMISSES
+		: classifier(size * assoc)
+#endif
 	{
+		static_assert(assoc <= 16, "a PLRUtree has at most 16 ways");
 		latency = l;
+		depth = d;
 		nextLevel = nl;
+		sets = size;
+		ways = assoc;
+		rows = &cache[0][0];
+		setState = state;
+#ifdef CLASSIFYMISSES
+		shadow = &classifier;
+#endif
+		below = nl;
 		byte data[LINESIZE] = {};
 		for (int i = 0; i < size; ++i)
 		{
-			trees[i] = PLRUtree(assoc);
+			state[i].tree = PLRUtree(assoc);
 			for (int j = 0; j < assoc; ++j)
 				cache[i][j] = CacheLine(0, data, false, false);
 		}
@@ -82,24 +316,217 @@ public:
 
 	// read data of type T at address
 	template<typename T>
-	T ReadData(std::uintptr_t address)
+	T ReadData(std::uintptr_t address) { return Get<true, T>(address); }
+
+	// write data of type T to address
+	template<typename T>
+	void WriteData(std::uintptr_t address, T value) { Put<true>(address, value); }
+
+	// functional warming versions of ReadData and WriteData, see CacheBase::WarmData
+	template<typename T>
+	T WarmData(std::uintptr_t address) { return Get<false, T>(address); }
+
+	template<typename T>
+	void WarmWrite(std::uintptr_t address, T value) { Put<false>(address, value); }
+
+	void Occupancy(std::uint16_t* valid, std::uint16_t* dirty) const
 	{
-		std::uintptr_t offset, index, tag;
-		AddressToOffsetIndexTag(address, offset, index, tag);
+		for (std::uint32_t i = 0; i < size; ++i)
+		{
+			valid[i] = dirty[i] = 0;
+			for (std::uint32_t j = 0; j < assoc; ++j)
+			{
+				valid[i] += cache[i][j].valid;
+				dirty[i] += cache[i][j].valid && cache[i][j].dirty;
+			}
+		}
+	}
 
-		byte data[sizeof(T)];
-		byte* line = ReadData(address);
-		for (int i = 0; i < sizeof(T); ++i)
-			data[i] = line[offset + i];
+	// write every dirty line to the next level and invalidate everything, then flush the next level
+	void Flush()
+	{
+		for (std::uint32_t i = 0; i < size; ++i)
+		{
+			for (std::uint32_t j = 0; j < assoc; ++j)
+			{
+				CacheLine& line = cache[i][j];
+				if (line.valid && line.dirty)
+				{
+					if (nextLevel == nullptr)
+						memory->Write(LineAddress(line.tag, i), LINESIZE, line.data);
+					else
+						nextLevel->WarmWrite(LineAddress(line.tag, i), LINESIZE, line.data);
+				}
+				line.valid = line.dirty = false;
+			}
+			state[i].tree = PLRUtree(assoc);
+		}
+		if (nextLevel != nullptr)
+			nextLevel->Flush();
+	}
 
-		return *reinterpret_cast<T*>(data);
+	void ResetStats()
+	{
+		CacheBase::ResetStats();
+		for (CacheSet& s : state)
+		{
+			s.reads = s.writes = s.readmisses = s.writemisses = 0;
+			memset(s.hits, 0, sizeof(s.hits));
+		}
 	}
 
-	// write data of type T to address
-	template<typename T>
-	void WriteData(std::uintptr_t address, T value)
+	void Tally()
 	{
-		WriteData(address, sizeof(T), reinterpret_cast<byte*>(&value));
+		reads = writes = readmisses = writemisses = 0;
+		for (const CacheSet& s : state)
+		{
+			reads += s.reads, writes += s.writes;
+			readmisses += s.readmisses, writemisses += s.writemisses;
+		}
+	}
+
+	void SetSampling(int shift)
+	{
+		if (shift > indexBits) // keep at least one set
+			shift = indexBits;
+		CacheBase::SetSampling(shift);
+		if (nextLevel != nullptr)
+			nextLevel->SetSampling(shift);
+	}
+
+	// counters, extended with extrapolated totals and a confidence interval when sets are sampled
+	void PrintStats()
+	{
+		Tally();
+		CacheBase::PrintStats();
+		std::cout << "Hit positions (most recently used first):";
+		for (std::uint32_t i = 0; i < assoc; ++i)
+		{
+			std::uint64_t hits = 0;
+			for (const CacheSet& s : state)
+				hits += s.hits[i];
+			std::cout << " " << hits;
+		}
+		std::cout << std::endl;
+		if (sampleShift == 0)
+			return;
+
+		// ratio estimator over the sampled sets, its variance follows from the spread between sets
+		int n = size >> sampleShift;
+		double accesses = 0, misses = 0;
+		for (std::uint32_t i = 0; i < size; i += 1u << sampleShift)
+			accesses += state[i].Accesses(), misses += state[i].Misses();
+		if (skipped > 0)
+			std::cout << "Skipped accesses: " << skipped << std::endl;
+		std::cout << "Sampled sets: " << n << " of " << size << std::endl;
+		std::cout << "Estimated accesses: " << ((std::uint64_t)accesses << sampleShift) << std::endl;
+		std::cout << "Estimated misses: " << ((std::uint64_t)misses << sampleShift) << std::endl;
+		if (accesses == 0)
+			return;
+
+		double rate = misses / accesses, sum = 0;
+		for (std::uint32_t i = 0; i < size; i += 1u << sampleShift)
+			sum += (state[i].Misses() - rate * state[i].Accesses()) * (state[i].Misses() - rate * state[i].Accesses());
+		double mean = accesses / n;
+		double variance = n > 1 ? (1.0 - (double)n / size) * sum / ((n - 1) * n * mean * mean) : 0;
+		std::cout << "Miss rate: " << 100.0 * rate << "% +/- " << 196.0 * sqrt(variance) << "% (95%)" << std::endl;
+	}
+
+	// tags, valid and dirty bits, PLRU bits and optionally the line data. Without data dirty lines
+	// are written through to memory, so every line can be reloaded from there on restore.
+	void Save(CheckpointWriter& out, bool data)
+	{
+		std::vector<std::uint64_t> tags(size * assoc);
+		std::vector<std::uint8_t> flags(size * assoc);
+		std::vector<std::uint16_t> plru(size);
+		for (std::uint32_t i = 0; i < size; ++i)
+		{
+			for (std::uint32_t j = 0; j < assoc; ++j)
+			{
+				const CacheLine& line = cache[i][j];
+				tags[i * assoc + j] = line.tag;
+				flags[i * assoc + j] = (line.valid ? 1 : 0) | (line.dirty ? 2 : 0);
+				if (!data && line.valid && line.dirty)
+					memory->Write(LineAddress(line.tag, i), LINESIZE, line.data);
+			}
+			plru[i] = (std::uint16_t)state[i].tree.getBits();
+		}
+
+		out.Write<std::uint32_t>(CHECKPOINTCACHE);
+		out.Write<std::uint32_t>(size);
+		out.Write<std::uint32_t>(assoc);
+		out.Write<std::uint32_t>(LINESIZE);
+		out.Write<std::uint32_t>(data ? 1 : 0);
+		out.Align(8);
+		out.Write(tags.data(), tags.size() * sizeof(std::uint64_t));
+		out.Write(flags.data(), flags.size());
+		out.Write(plru.data(), plru.size() * sizeof(std::uint16_t));
+		if (data)
+		{
+			out.Align(LINESIZE);
+			for (std::uint32_t i = 0; i < size; ++i)
+				for (std::uint32_t j = 0; j < assoc; ++j)
+					out.Write(cache[i][j].data, LINESIZE);
+		}
+		out.Align(8);
+	}
+
+	bool Load(CheckpointReader& in, bool apply)
+	{
+		std::uint32_t kind = 0, sets = 0, ways = 0, lineSize = 0, data = 0;
+		in.Read(kind), in.Read(sets), in.Read(ways), in.Read(lineSize), in.Read(data);
+		if (in.Failed() || kind != CHECKPOINTCACHE || sets != size || ways != assoc || lineSize != LINESIZE)
+			return false;
+
+		in.Align(8);
+		const byte* tags = in.Take(size * assoc * sizeof(std::uint64_t));
+		const byte* flags = in.Take(size * assoc);
+		const byte* plru = in.Take(size * sizeof(std::uint16_t));
+		const byte* lines = nullptr;
+		if (data)
+		{
+			in.Align(LINESIZE);
+			lines = in.Take(size * assoc * LINESIZE);
+		}
+		in.Align(8);
+		if (in.Failed() || !apply)
+			return !in.Failed();
+
+		for (std::uint32_t i = 0; i < size; ++i)
+		{
+			for (std::uint32_t j = 0; j < assoc; ++j)
+			{
+				CacheLine& line = cache[i][j];
+				std::uint64_t tag;
+				memcpy(&tag, tags + (i * assoc + j) * sizeof(std::uint64_t), sizeof(tag));
+				line.tag = (std::uintptr_t)tag;
+				line.valid = (flags[i * assoc + j] & 1) != 0;
+				line.dirty = (flags[i * assoc + j] & 2) != 0;
+				line.set = j;
+				if (lines != nullptr)
+					memcpy(line.data, lines + (i * assoc + j) * LINESIZE, LINESIZE);
+				else if (line.valid)
+					memory->Read(LineAddress(line.tag, i), LINESIZE, line.data);
+			}
+			std::uint16_t bits;
+			memcpy(&bits, plru + i * sizeof(std::uint16_t), sizeof(bits));
+			state[i].tree.setBits(bits);
+		}
+		return true;
+	}
+
+	// accesses and misses of every set as CSV
+	bool WriteSetStats(const char* file) const
+	{
+		FILE* f = fopen(file, "w");
+		if (f == nullptr)
+			return false;
+
+		fprintf(f, "set,accesses,misses\n");
+		for (std::uint32_t i = 0; i < size; ++i)
+			fprintf(f, "%u,%llu,%llu\n", i, (unsigned long long)state[i].Accesses(), (unsigned long long)state[i].Misses());
+		fclose(f);
+		return true;
 	}
 
 	// prints all the data in the cache to console
@@ -109,9 +536,9 @@ public:
 		{
 			for (int j = 0; j < assoc; ++j)
 			{
-				std::cout << "(0x" << std::hex << setfill('0') << setw(sizeof(cache[i][j].tag) * 2) << cache[i][j].tag << std::dec << ", 0x";
+				std::cout << "(0x" << std::hex << std::setfill('0') << std::setw(sizeof(cache[i][j].tag) * 2) << cache[i][j].tag << std::dec << ", 0x";
 				for (int k = LINESIZE - 1; k >= 0; --k)
-					std::cout << std::hex << setfill('0') << setw(sizeof(cache[i][j].data[k]) * 2) << (int)cache[i][j].data[k];
+					std::cout << std::hex << std::setfill('0') << std::setw(sizeof(cache[i][j].data[k]) * 2) << (int)cache[i][j].data[k];
 				std::cout << std::dec << ", " << cache[i][j].valid << ", " << cache[i][j].dirty << ")" << std::endl;
 			}
 			std::cout << std::endl;
@@ -121,45 +548,135 @@ public:
 private:
 	CacheLine cache[size][assoc]; // the data
 	CacheBase* nextLevel; // pointer to next cache level, nullptr if next level is RAM
-	PLRUtree trees[size]; // the trees for PLRU eviction
+	CacheSet state[size] = {}; // the trees for PLRU eviction and the counters, for the totals, sampling estimates and set histograms
+#ifdef CLASSIFYMISSES
+	MissClassifier classifier;
+#endif
+
+	template<bool detailed, typename T>
+	T Get(std::uintptr_t address)
+	{
+		T value;
+		if (address & sampleMask) // set is not sampled, go straight to memory
+		{
+			if (detailed)
+				skipped++;
+			memory->Read(address, sizeof(T), reinterpret_cast<byte*>(&value));
+			return value;
+		}
 
-	// get cacheline data containing address
-	byte* ReadData(std::uintptr_t address)
+		byte* line = Read<detailed>(address);
+		memcpy(&value, line + (address & (LINESIZE - 1)), sizeof(T));
+		return value;
+	}
+
+	template<bool detailed, typename T>
+	void Put(std::uintptr_t address, T value)
 	{
-		reads++;
+		if (address & sampleMask) // set is not sampled, go straight to memory
+		{
+			if (detailed)
+				skipped++;
+			memory->Write(address, sizeof(T), reinterpret_cast<byte*>(&value));
+			return;
+		}
 
+		Write<detailed>(address, sizeof(T), reinterpret_cast<byte*>(&value));
+	}
+
+	byte* ReadData(std::uintptr_t address) { return Read<true>(address); }
+	void WriteData(std::uintptr_t address, int nrOfBytes, byte* data) { Write<true>(address, nrOfBytes, data); }
+	byte* WarmData(std::uintptr_t address) { return Read<false>(address); }
+	void WarmWrite(std::uintptr_t address, int nrOfBytes, byte* data) { Write<false>(address, nrOfBytes, data); }
+
+	// get cacheline data containing address, counting stats if detailed
+	template<bool detailed>
+	byte* Read(std::uintptr_t address)
+	{
+		PROFILEBEGIN(t);
 		std::uintptr_t offset, index, tag;
 		AddressToOffsetIndexTag(address, offset, index, tag);
 
+		CacheSet& set = state[index];
+		if (detailed)
+		{
+			set.reads++;
+			Clock() += latency;
+		}
+#ifdef CLASSIFYMISSES
+		MissKind kind = classifier.Access(address >> offsetBits); // warming keeps the shadow cache up to date too
+#endif
+		PROFILEPHASE(PHASESTATS, t);
 		CacheLine* line = FindData(address);
-		if (line == nullptr) // data not in cache yet
+		PROFILEPHASE(PHASELOOKUP, t);
+		bool hit = line != nullptr;
+		if (!hit) // data not in cache yet
 		{
-			line = LoadData(address);
-			readmisses++;
+			if (detailed) // a miss below this one overwrites it
+				MissDepth() = depth;
+			line = LoadData<detailed>(address);
+			PROFILESKIP(t);
+			if (detailed)
+			{
+				set.readmisses++;
+#ifdef CLASSIFYMISSES
+				misses3C[kind]++;
+#endif
+			}
 		}
+		PROFILEPHASE(PHASESTATS, t);
 
-		trees[index].setPath(line->set); // update eviction policy
+		if (detailed && hit) // update eviction policy, counting how close to eviction the line was
+			set.hits[set.tree.touch(line->set)]++;
+		else
+			set.tree.setPath(line->set);
+		PROFILEPHASE(PHASEREPLACE, t);
 		return line->data;
 	}
 
-	// write data to cache at address
-	void WriteData(std::uintptr_t address, int nrOfBytes, byte* data)
+	// write data to cache at address, counting stats if detailed
+	template<bool detailed>
+	void Write(std::uintptr_t address, int nrOfBytes, byte* data)
 	{
-		writes++;
-
+		PROFILEBEGIN(t);
 		std::uintptr_t offset, index, tag;
 		AddressToOffsetIndexTag(address, offset, index, tag);
 
+		CacheSet& set = state[index];
+		if (detailed)
+		{
+			set.writes++;
+			Clock() += latency;
+		}
+#ifdef CLASSIFYMISSES
+		MissKind kind = classifier.Access(address >> offsetBits);
+#endif
+		PROFILEPHASE(PHASESTATS, t);
 		CacheLine* line = FindData(address);
-		if (line == nullptr) // data not in cache yet
+		PROFILEPHASE(PHASELOOKUP, t);
+		bool hit = line != nullptr;
+		if (!hit) // data not in cache yet
 		{
-			line = LoadData(address);
-			writemisses++;
+			if (detailed && depth == 1) // below the first level writes are write backs
+				MissDepth() = depth;
+			line = LoadData<detailed>(address);
+			PROFILESKIP(t);
+			if (detailed)
+			{
+				set.writemisses++;
+#ifdef CLASSIFYMISSES
+				misses3C[kind]++;
+#endif
+			}
 		}
+		PROFILEPHASE(PHASESTATS, t);
 
-		trees[index].setPath(line->set); // update eviction policy
-		for (int i = 0; i < nrOfBytes; ++i)
-			line->data[offset + i] = data[i];
+		if (detailed && hit) // update eviction policy, counting how close to eviction the line was
+			set.hits[set.tree.touch(line->set)]++;
+		else
+			set.tree.setPath(line->set);
+		PROFILEPHASE(PHASEREPLACE, t);
+		memcpy(line->data + offset, data, nrOfBytes);
 
 		line->dirty = true;
 	}
@@ -179,24 +696,20 @@ private:
 
 	// makes sure data at address is in cache and returns address of line
 	// use only when data is not in cache!
+	template<bool detailed>
 	CacheLine* LoadData(std::uintptr_t address)
 	{
+		PROFILECONTINUE(t);
 		std::uintptr_t offset, index, tag;
 		AddressToOffsetIndexTag(address, offset, index, tag);
 
+		// copy the line, the eviction below may overwrite its source in the next level
 		byte data[LINESIZE];
 		if (nextLevel == nullptr) // retrieve from RAM
-		{
-			std::uintptr_t lineStart = address - (address % LINESIZE);
-			for (int i = 0; i < LINESIZE; ++i)
-				data[i] = ReadFromRAM<byte>(reinterpret_cast<byte*>(lineStart + i));
-		}
+			memory->Read(address - offset, LINESIZE, data);
 		else // retrieve from higher level cache
-		{
-			byte* cacheData = nextLevel->ReadData(address);
-			for (int i = 0; i < LINESIZE; ++i)
-				data[i] = cacheData[i];
-		}
+			memcpy(data, detailed ? nextLevel->ReadData(address) : nextLevel->WarmData(address), LINESIZE);
+		PROFILEPHASE(PHASENEXT, t);
 
 		CacheLine cl(tag, data, true, false);
 
@@ -206,32 +719,44 @@ private:
 			{
 				cl.set = i;
 				row[i] = cl;
+				PROFILEPHASE(PHASEFILL, t);
 				return &row[i];
 			}
 
 		// no room left in set, evict something
-		int evict = trees[index].getOverwriteTarget();
+		int evict = state[index].tree.getOverwriteTarget();
+		if (detailed)
+			(row[evict].dirty ? dirtyevicts : cleanevicts)++;
+		PROFILEPHASE(PHASEEVICT, t);
 		if (row[evict].dirty) // need to write evicted data to higher level
 		{
-			// reconstruct address of first byte in evicted cache line
-			std::uint32_t oldAddress = 0;
-			oldAddress += row[evict].tag << (offsetBits + indexBits);
-			oldAddress += index << offsetBits;
+			std::uintptr_t oldAddress = LineAddress(row[evict].tag, index);
 
 			if (nextLevel == nullptr) // evict to RAM
-				for (int i = 0; i < LINESIZE; ++i)
-					WriteToRAM<byte>(reinterpret_cast<byte*>(oldAddress + i), row[evict].data[i]);
-			else // evict to higher cache level
+				memory->Write(oldAddress, LINESIZE, row[evict].data);
+			else if (detailed) // evict to higher cache level, where a write allocate miss is not a demand miss
+			{
+				int missDepth = MissDepth();
 				nextLevel->WriteData(oldAddress, LINESIZE, row[evict].data);
-
-			evicts++;
+				MissDepth() = missDepth;
+			}
+			else
+				nextLevel->WarmWrite(oldAddress, LINESIZE, row[evict].data);
+			PROFILEPHASE(PHASENEXT, t);
 		}
 
 		cl.set = evict;
 		row[evict] = cl; // put line in cache
+		PROFILEPHASE(PHASEFILL, t);
 		return &row[evict];
 	}
 
+	// reconstruct address of first byte in a cache line
+	std::uintptr_t LineAddress(std::uintptr_t tag, std::uintptr_t index) const
+	{
+		return (tag << (offsetBits + indexBits)) + (index << offsetBits);
+	}
+
 	// split address into offset, index and tag
 	void AddressToOffsetIndexTag(std::uintptr_t address, std::uintptr_t& offset, std::uintptr_t& index, std::uintptr_t& tag) const
 	{
@@ -0,0 +1,194 @@
+#include "sim.h"
+#include "patterns.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <memory>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Benchmark of the simulator itself: fixed synthetic access patterns run through several hierarchy
+// geometries, reporting simulated accesses per second, ns per access and the simulator's footprint per
+// run, and the peak RSS of the whole benchmark, as JSON.
+// Every run starts from empty caches and memory, so miss counts must match between builds and
+// only the time may change. Build with 'make cachebench'.
+
+// runs a workload through the first level, returns something depending on every value read
+template<typename L1>
+static std::uint64_t Run(L1& l1, const Workload& w, std::uint64_t n)
+{
+	std::uint64_t sum = 0;
+	if (!w.chain.empty())
+	{
+		std::uint64_t address = PATTERNBASE;
+		for (std::uint64_t i = 0; i < n; ++i)
+			address = l1.template ReadData<std::uint64_t>(address);
+		return address;
+	}
+	for (const TraceRecord& r : w.accesses)
+		if (r.write) l1.WriteData(r.address, (int)r.address);
+		else sum += l1.template ReadData<int>(r.address);
+	return sum;
+}
+
+// a hierarchy built from template parameters, so the benchmark runs the same code the simulator does.
+// PLRUtree needs 2 to 16 ways.
+class Geometry
+{
+public:
+	virtual ~Geometry() { }
+	virtual const char* Name() const = 0;
+	virtual CacheBase* Level(int i) = 0;
+	virtual std::size_t Bytes() const = 0; // of the levels, tags, data and set state
+	virtual std::uint64_t Run(const Workload& w, std::uint64_t n) = 0;
+};
+
+template<std::uint32_t size1, std::uint32_t assoc1, std::uint32_t size2, std::uint32_t assoc2, std::uint32_t size3, std::uint32_t assoc3>
+class Hierarchy : public Geometry
+{
+public:
+	Hierarchy(const char* n) : name(n), l3(&ram, L3LATENCY), l2(&l3, L2LATENCY), l1(&l2, L1LATENCY) { }
+	const char* Name() const { return name; }
+	CacheBase* Level(int i) { CacheBase* levels[] = { &l1, &l2, &l3, &ram }; return levels[i]; }
+	std::size_t Bytes() const { return sizeof(*this); }
+	std::uint64_t Run(const Workload& w, std::uint64_t n) { return ::Run(l1, w, n); }
+private:
+	const char* name;
+	DRAM ram;
+	Cache<size3, assoc3> l3;
+	Cache<size2, assoc2> l2;
+	Cache<size1, assoc1> l1;
+};
+
+static const char* geometryNames[] = { "haswell", "small", "lowassoc", "highassoc" };
+
+static Geometry* CreateGeometry(int i)
+{
+	switch (i)
+	{
+	case 0: return new Hierarchy<64, 8, 512, 8, 2048, 16>(geometryNames[0]); // the simulator's, see sim.cpp
+	case 1: return new Hierarchy<64, 4, 256, 8, 1024, 16>(geometryNames[1]); // 16KB, 128KB, 1MB
+	case 2: return new Hierarchy<256, 2, 2048, 2, 8192, 4>(geometryNames[2]); // same sizes, 2-way L1 and L2, 4-way L3
+	default: return new Hierarchy<32, 16, 256, 16, 2048, 16>(geometryNames[3]); // same sizes, 16-way everywhere
+	}
+}
+
+// peak resident set size of this process so far, in KB
+static std::uint64_t PeakRSS()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return counters.PeakWorkingSetSize / 1024;
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	return usage.ru_maxrss / 1024; // bytes on macOS
+#else
+	return usage.ru_maxrss;
+#endif
+#endif
+}
+
+static void Usage()
+{
+	fprintf(stderr, "usage: cachebench [options]\n");
+	fprintf(stderr, "  -n accesses    accesses per run (default 1048576)\n");
+	fprintf(stderr, "  -r repeats     runs per pattern and geometry, the fastest counts (default 3)\n");
+	fprintf(stderr, "  -p pattern     only run this pattern: sequential, strided, random, pointerchase or subdivide\n");
+	fprintf(stderr, "  -g geometry    only run this geometry: haswell, small, lowassoc or highassoc\n");
+	fprintf(stderr, "  -o file        write the JSON results to file instead of stdout\n");
+}
+
+int main(int argc, char** argv)
+{
+	std::uint64_t n = 1 << 20;
+	int repeats = 3;
+	const char* pattern = nullptr, *geometry = nullptr, *output = nullptr;
+	for (int i = 1; i < argc; ++i)
+	{
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "-n") == 0 && hasValue) n = strtoull(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "-r") == 0 && hasValue) repeats = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-p") == 0 && hasValue) pattern = argv[++i];
+		else if (strcmp(argv[i], "-g") == 0 && hasValue) geometry = argv[++i];
+		else if (strcmp(argv[i], "-o") == 0 && hasValue) output = argv[++i];
+		else
+		{
+			Usage();
+			return 1;
+		}
+	}
+	if (n == 0 || repeats < 1)
+	{
+		Usage();
+		return 1;
+	}
+
+	FILE* f = output != nullptr ? fopen(output, "w") : stdout;
+	if (f == nullptr)
+	{
+		fprintf(stderr, "Could not open %s\n", output);
+		return 1;
+	}
+
+	std::vector<Workload> workloads;
+	const std::uint64_t seeds[] = { 1, 1, 0x9e3779b97f4a7c15ull, 0x2545f4914f6cdd1dull, 0x853c49e6748fea9bull };
+	for (int p = 0; p < 5; ++p)
+		if (pattern == nullptr || strcmp(pattern, patternNames[p]) == 0)
+			workloads.push_back(Generate((PatternKind)p, n, seeds[p]));
+
+	fprintf(f, "{\n\"benchmark\":\"cachebench\",\"accesses\":%llu,\"repeats\":%i,\n\"results\":[", (unsigned long long)n, repeats);
+	int results = 0;
+	std::uint64_t check = 0;
+	for (int g = 0; g < 4; ++g)
+	{
+		if (geometry != nullptr && strcmp(geometry, geometryNames[g]) != 0)
+			continue;
+		for (const Workload& w : workloads)
+		{
+			double best = 0;
+			std::uint64_t misses[3] = {}, footprint = 0;
+			for (int r = 0; r < repeats; ++r)
+			{
+				SimMemory* memory = SimMemory::GetMemory();
+				memory->Clear();
+				for (std::size_t i = 0; i < w.chain.size(); ++i)
+					memory->Write(PATTERNBASE + i * LINESIZE, sizeof(std::uint64_t), reinterpret_cast<const byte*>(&w.chain[i]));
+				std::unique_ptr<Geometry> hierarchy(CreateGeometry(g));
+
+				auto start = std::chrono::steady_clock::now();
+				check += hierarchy->Run(w, n);
+				std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+				if (r == 0 || elapsed.count() < best)
+					best = elapsed.count();
+				for (int l = 0; l < 3; ++l)
+				{
+					hierarchy->Level(l)->Tally();
+					misses[l] = hierarchy->Level(l)->readmisses + hierarchy->Level(l)->writemisses;
+				}
+				footprint = hierarchy->Bytes() + memory->Footprint();
+			}
+
+			double nsPerAccess = best * 1e9 / n;
+			fprintf(f, "%s\n{\"geometry\":\"%s\",\"pattern\":\"%s\",\"seconds\":%.6f,\"accesses_per_second\":%.0f,\"ns_per_access\":%.3f,", results++ > 0 ? "," : "",
+				geometryNames[g], w.name, best, n / best, nsPerAccess);
+			fprintf(f, "\"l1_misses\":%llu,\"l2_misses\":%llu,\"l3_misses\":%llu,\"footprint_kb\":%llu}",
+				(unsigned long long)misses[0], (unsigned long long)misses[1], (unsigned long long)misses[2], (unsigned long long)(footprint / 1024));
+			fprintf(stderr, "%-10s %-13s %8.2f ns/access %8.2f M accesses/s\n", geometryNames[g], w.name, nsPerAccess, n / best / 1e6);
+		}
+	}
+	// the checksum uses every value read, so none of the reads can be optimized away
+	fprintf(f, "\n],\n\"peak_rss_kb\":%llu,\"checksum\":%llu\n}\n", (unsigned long long)PeakRSS(), (unsigned long long)check);
+	if (f != stdout)
+		fclose(f);
+	return 0;
+}
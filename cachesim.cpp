@@ -0,0 +1,246 @@
+#include "sim.h"
+#include "hardware.h"
+#include "intervals.h"
+#include "pipeline.h"
+#include "regress.h"
+#include "sweep.h"
+#include "terrain.h"
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+// Headless batch simulator: runs a workload or a recorded trace through the hierarchy as fast as the
+// host allows, without a window or frame loop, and prints the stats to stdout or a file.
+// Builds without SDL, OpenGL or Windows, see the cachesim target in the makefile.
+
+static void Usage()
+{
+	std::cerr << "usage: cachesim [options]" << std::endl;
+	std::cerr << "  -w terrain     run a workload (default terrain)" << std::endl;
+	std::cerr << "  -seed n        seed of the workload (default " << TERRAINSEED << ")" << std::endl;
+	std::cerr << "  -threads n     run n terrains at once with seeds seed to seed + n - 1, needs SIMQUEUES" << std::endl;
+	std::cerr << "  -t trace.bin   replay a recorded trace instead, every access in detail" << std::endl;
+	std::cerr << "  -s             sample the trace with SMARTS instead of replaying all of it" << std::endl;
+	std::cerr << "  -sweep file    run the trace through every hierarchy in file (or grid for a built-in one), CSV out" << std::endl;
+	std::cerr << "  -j n           sweep on n threads (default every hardware thread)" << std::endl;
+	std::cerr << "  -pipeline      run the trace tag-only with a thread per level, counters and DRAM timing out" << std::endl;
+	std::cerr << "  -level n       the trace is what level n sees, as written by -filter (default 1)" << std::endl;
+	std::cerr << "  -filter n out  write the fills and write backs leaving level n for the trace to out" << std::endl;
+	std::cerr << "  -o stats.txt   write the stats to a file instead of stdout" << std::endl;
+	std::cerr << "  -i file        stream interval stats to file (CSV, or JSON if it ends in .json)" << std::endl;
+	std::cerr << "  -n length      interval length in accesses (default " << INTERVALLENGTH << ")" << std::endl;
+	std::cerr << "  -r golden.txt  run the regression corpus against the reference model and golden counters" << std::endl;
+	std::cerr << "  -u golden.txt  run the regression corpus and write its counters as the new golden ones" << std::endl;
+	std::cerr << "  -hw pattern    run a pattern natively and simulated, hardware counters next to simulated ones" << std::endl;
+	std::cerr << "                 (sequential, strided, random, pointerchase or subdivide)" << std::endl;
+	std::cerr << "  -a n           accesses of the -hw pattern (default " << HWACCESSES << ")" << std::endl;
+}
+
+// the terrain generation the game visualizes, measured as a whole. More than one thread shares the
+// hierarchy through the access queues, every thread with a terrain of its own.
+static void RunTerrain(std::uint32_t seed, int threads)
+{
+	std::vector<std::unique_ptr<Terrain>> terrains; // 2KB task stack and a pointer to the map each
+	for (int i = 0; i < threads; ++i)
+	{
+		terrains.emplace_back(new Terrain());
+		terrains[i]->Init(seed + i); // places and registers regions, which has to happen before the threads start
+	}
+	SimRoiBegin();
+	if (threads == 1)
+		while (terrains[0]->Step());
+	else
+	{
+		std::vector<std::thread> workers;
+		for (std::unique_ptr<Terrain>& t : terrains)
+			workers.emplace_back([&t]() { while (t->Step()); });
+		for (std::thread& w : workers)
+			w.join();
+	}
+	SimRoiEnd();
+}
+
+// every access in detail, as level first saw it when the trace was recorded
+static bool ReplayTrace(const char* file, CacheBase* first)
+{
+	TraceReader in(file);
+	if (!in.IsOpen())
+		return false;
+
+	static TraceRecord records[TRACEBUFFER];
+	byte zeros[LINESIZE] = {}; // traces carry no values
+	int n;
+	while ((n = in.Read(records, TRACEBUFFER)) > 0)
+		for (int i = 0; i < n; ++i)
+		{
+			const TraceRecord& r = records[i];
+			if (r.write) first->WriteData(r.address, r.size, zeros);
+			else first->ReadData(r.address);
+		}
+	return true;
+}
+
+// options from the command line
+struct Options
+{
+	const char* workload = "terrain", *trace = nullptr, *output = nullptr, *intervals = nullptr, *golden = nullptr, *hardware = nullptr, *sweep = nullptr, *filtered = nullptr;
+	bool sample = false, update = false, pipeline = false;
+	std::uint32_t seed = TERRAINSEED;
+	int threads = 1, level = 1, filterLevel = 0;
+	unsigned int sweepThreads = 0;
+	std::uint64_t intervalLength = INTERVALLENGTH, accesses = HWACCESSES;
+};
+
+static bool Parse(int argc, char** argv, Options& options)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "-w") == 0 && hasValue) options.workload = argv[++i];
+		else if (strcmp(argv[i], "-t") == 0 && hasValue) options.trace = argv[++i];
+		else if (strcmp(argv[i], "-s") == 0) options.sample = true;
+		else if (strcmp(argv[i], "-sweep") == 0 && hasValue) options.sweep = argv[++i];
+		else if (strcmp(argv[i], "-j") == 0 && hasValue) options.sweepThreads = (unsigned int)strtoul(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "-pipeline") == 0) options.pipeline = true;
+		else if (strcmp(argv[i], "-level") == 0 && hasValue) options.level = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-filter") == 0 && i + 2 < argc) options.filterLevel = atoi(argv[++i]), options.filtered = argv[++i];
+		else if (strcmp(argv[i], "-o") == 0 && hasValue) options.output = argv[++i];
+		else if (strcmp(argv[i], "-i") == 0 && hasValue) options.intervals = argv[++i];
+		else if (strcmp(argv[i], "-n") == 0 && hasValue) options.intervalLength = strtoull(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "-threads") == 0 && hasValue) options.threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-seed") == 0 && hasValue) options.seed = (std::uint32_t)strtoul(argv[++i], nullptr, 0);
+		else if (strcmp(argv[i], "-r") == 0 && hasValue) options.golden = argv[++i];
+		else if (strcmp(argv[i], "-u") == 0 && hasValue) options.golden = argv[++i], options.update = true;
+		else if (strcmp(argv[i], "-hw") == 0 && hasValue) options.hardware = argv[++i];
+		else if (strcmp(argv[i], "-a") == 0 && hasValue) options.accesses = strtoull(argv[++i], nullptr, 10);
+		else return false;
+	}
+	return true;
+}
+
+static int Simulate(const Options& options)
+{
+	if (options.golden != nullptr) // from empty caches, without the sampling or checkpoint SimInit may set up
+		return RunRegression(options.golden, options.update) == 0 ? 0 : 1;
+	if (options.sweep != nullptr) // tag-only hierarchies of its own, the simulated one is not used
+	{
+		if (options.trace == nullptr)
+		{
+			std::cerr << "A sweep needs a trace, see -t" << std::endl;
+			return 1;
+		}
+		return RunSweep(options.trace, strcmp(options.sweep, "grid") == 0 ? nullptr : options.sweep, options.sweepThreads, options.level) ? 0 : 1;
+	}
+	if (options.pipeline) // tag-only as well
+	{
+		if (options.trace == nullptr)
+		{
+			std::cerr << "The pipeline needs a trace, see -t" << std::endl;
+			return 1;
+		}
+		return RunPipeline(options.trace, options.level) ? 0 : 1;
+	}
+	if (options.filtered != nullptr)
+	{
+		if (options.trace == nullptr || options.filterLevel < options.level || options.filterLevel > 3)
+		{
+			std::cerr << "Filtering needs a trace, see -t, and a level from -level to 3" << std::endl;
+			return 1;
+		}
+		return WriteFiltered(options.trace, options.level, options.filterLevel, options.filtered) ? 0 : 1;
+	}
+	if (options.hardware != nullptr)
+	{
+		for (int kind = PATTERNSEQUENTIAL; kind <= PATTERNSUBDIVIDE; ++kind)
+			if (strcmp(options.hardware, patternNames[kind]) == 0)
+			{
+				CompareWithHardware((PatternKind)kind, options.accesses, options.seed);
+				return 0;
+			}
+		std::cerr << "Unknown pattern " << options.hardware << std::endl;
+		return 1;
+	}
+
+	SimInit();
+	if (options.intervals != nullptr && !SimStartIntervals(options.intervals, INTERVALACCESSES, options.intervalLength))
+		std::cerr << "Could not open " << options.intervals << std::endl;
+
+	auto start = std::chrono::steady_clock::now();
+	if (options.trace != nullptr && options.sample)
+	{
+		CacheBase* hierarchy[] = { &l1, &l2, &l3 };
+		SmartsSampler sampler(hierarchy, 3);
+		if (!sampler.Run(options.trace))
+		{
+			std::cerr << "Could not read " << options.trace << std::endl;
+			return 1;
+		}
+		sampler.PrintStats();
+		std::cout << std::endl;
+	}
+	else if (options.trace != nullptr)
+	{
+		CacheBase* hierarchy[] = { &l1, &l2, &l3 };
+		if (!ReplayTrace(options.trace, hierarchy[options.level - 1]))
+		{
+			std::cerr << "Could not read " << options.trace << std::endl;
+			return 1;
+		}
+	}
+	else
+		RunTerrain(options.seed, options.threads);
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+	std::cout << "Simulation time: " << elapsed.count() << "ms" << std::endl << std::endl;
+	SimPrintStats();
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!Parse(argc, argv, options))
+	{
+		Usage();
+		return 1;
+	}
+	if (options.trace == nullptr && strcmp(options.workload, "terrain") != 0)
+	{
+		std::cerr << "Unknown workload " << options.workload << std::endl;
+		return 1;
+	}
+#ifndef SIMQUEUES
+	if (options.threads != 1)
+	{
+		std::cerr << "More than one thread needs a build with SIMQUEUES, see simconfig.h" << std::endl;
+		return 1;
+	}
+#endif
+	if (options.threads < 1)
+	{
+		std::cerr << "Invalid number of threads " << options.threads << std::endl;
+		return 1;
+	}
+	if (options.level < 1 || options.level > 3 || (options.level > 1 && (options.trace == nullptr || options.sample)))
+	{
+		std::cerr << "A level other than 1 needs a trace, see -t, and no sampling" << std::endl;
+		return 1;
+	}
+	if (options.output == nullptr)
+		return Simulate(options);
+
+	std::ofstream output(options.output);
+	if (!output)
+	{
+		std::cerr << "Could not open " << options.output << std::endl;
+		return 1;
+	}
+	std::streambuf* console = std::cout.rdbuf(output.rdbuf());
+	int result = Simulate(options);
+	std::cout.rdbuf(console);
+	return result;
+}
@@ -0,0 +1,151 @@
+#include "cache.h"
+#include "checkpoint.h"
+#include <algorithm>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Layout: magic, number of levels and a data flag, then every level from the last one up
+// (so dirty lines written through without data end up newest in memory), then the memory:
+// the number of pages, their page numbers and, aligned to a page, the contents of every page.
+bool Checkpoint::Save(const char* file, CacheBase** levels, int nrOfLevels, bool data)
+{
+	CheckpointWriter out(file);
+	if (!out.IsOpen())
+		return false;
+
+	out.Write(CHECKPOINTMAGIC, 8);
+	out.Write<std::uint32_t>(nrOfLevels);
+	out.Write<std::uint32_t>(data ? 1 : 0);
+	for (int l = nrOfLevels - 1; l >= 0; --l)
+		levels[l]->Save(out, data);
+
+	SimMemory* memory = levels[0]->memory;
+	std::vector<std::uint64_t> pages;
+	pages.reserve(memory->Pages().size());
+	for (const std::pair<const std::uint64_t, byte*>& page : memory->Pages())
+		pages.push_back(page.first);
+	std::sort(pages.begin(), pages.end());
+
+	out.Write<std::uint64_t>(pages.size());
+	out.Write(pages.data(), pages.size() * sizeof(std::uint64_t));
+	out.Align(PAGESIZE);
+	for (std::uint64_t page : pages)
+		out.Write(memory->Page(page * PAGESIZE), PAGESIZE);
+	return out.Close();
+}
+
+bool Checkpoint::Restore(const char* file, CacheBase** levels, int nrOfLevels)
+{
+	Checkpoint mapped;
+	if (!mapped.Map(file))
+		return false;
+
+	// check everything before changing anything
+	CheckpointReader in(mapped.view, mapped.size);
+	char magic[8];
+	std::uint32_t n = 0, data = 0;
+	in.Read(magic), in.Read(n), in.Read(data);
+	if (in.Failed() || memcmp(magic, CHECKPOINTMAGIC, 8) != 0 || (int)n != nrOfLevels)
+		return false;
+	for (int l = nrOfLevels - 1; l >= 0; --l)
+		if (!levels[l]->Load(in, false))
+			return false;
+
+	std::uint64_t count = 0;
+	in.Read(count);
+	if (count > mapped.size / PAGESIZE)
+		return false;
+	byte* numbers = in.Take(count * sizeof(std::uint64_t));
+	in.Align(PAGESIZE);
+	byte* contents = in.Take(count * PAGESIZE);
+	if (in.Failed())
+		return false;
+
+	// memory first, levels restored without data reload their lines from it
+	SimMemory* memory = levels[0]->memory;
+	memory->Clear();
+	for (std::uint64_t i = 0; i < count; ++i)
+	{
+		std::uint64_t page;
+		memcpy(&page, numbers + i * sizeof(std::uint64_t), sizeof(page));
+		memory->Attach(page, contents + i * PAGESIZE);
+	}
+
+	CheckpointReader levelsIn(mapped.view, mapped.size);
+	levelsIn.Take(8 + 2 * sizeof(std::uint32_t));
+	for (int l = nrOfLevels - 1; l >= 0; --l)
+		levels[l]->Load(levelsIn, true);
+
+	// keep the new mapping alive, pages of an earlier restore are no longer referenced
+	Unmap();
+	view = mapped.view, size = mapped.size, mapping = mapped.mapping;
+	mapped.view = nullptr, mapped.mapping = nullptr;
+	return true;
+}
+
+// map the whole file copy-on-write, writes to restored pages never reach the file
+bool Checkpoint::Map(const char* file)
+{
+#ifdef _WIN32
+	HANDLE f = CreateFileA(file, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (f == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER length;
+	if (!GetFileSizeEx(f, &length) || length.QuadPart == 0)
+	{
+		CloseHandle(f);
+		return false;
+	}
+	HANDLE m = CreateFileMappingA(f, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+	CloseHandle(f); // the mapping keeps the file open
+	if (m == nullptr)
+		return false;
+	void* v = MapViewOfFile(m, FILE_MAP_COPY, 0, 0, 0);
+	if (v == nullptr)
+	{
+		CloseHandle(m);
+		return false;
+	}
+	mapping = m;
+	size = (std::size_t)length.QuadPart;
+#else
+	int f = open(file, O_RDONLY);
+	if (f == -1)
+		return false;
+	struct stat info;
+	if (fstat(f, &info) != 0 || info.st_size == 0)
+	{
+		close(f);
+		return false;
+	}
+	void* v = mmap(nullptr, (std::size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, f, 0);
+	close(f); // the mapping keeps the file open
+	if (v == MAP_FAILED)
+		return false;
+	size = (std::size_t)info.st_size;
+#endif
+	view = static_cast<unsigned char*>(v);
+	return true;
+}
+
+void Checkpoint::Unmap()
+{
+	if (view == nullptr)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(view);
+	CloseHandle(mapping);
+#else
+	munmap(view, size);
+#endif
+	view = nullptr;
+	mapping = nullptr;
+	size = 0;
+}
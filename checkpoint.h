@@ -0,0 +1,127 @@
+#pragma once
+#include <stdint.h>
+#include <cstdint>
+#include <stdio.h>
+#include <string.h>
+
+#define CHECKPOINTMAGIC "CSCKPT01"
+
+class CacheBase;
+
+// sequential writer for checkpoint files, remembers if any write failed
+class CheckpointWriter
+{
+public:
+	CheckpointWriter(const char* file) { f = fopen(file, "wb"); }
+	~CheckpointWriter() { Close(); }
+
+	bool IsOpen() const { return f != nullptr; }
+
+	void Write(const void* data, std::size_t bytes)
+	{
+		if (f != nullptr && fwrite(data, 1, bytes, f) != bytes)
+			failed = true;
+		offset += bytes;
+	}
+
+	template<typename T>
+	void Write(const T& value) { Write(&value, sizeof(T)); }
+
+	// pad with zeros up to a multiple of alignment, so the reader can use the data in place
+	void Align(std::size_t alignment)
+	{
+		static const unsigned char zeros[64] = {};
+		while (offset % alignment != 0)
+		{
+			std::size_t pad = alignment - offset % alignment;
+			Write(zeros, pad < sizeof(zeros) ? pad : sizeof(zeros));
+		}
+	}
+
+	// returns false if anything went wrong since opening
+	bool Close()
+	{
+		if (f == nullptr)
+			return false;
+		if (fclose(f) != 0)
+			failed = true;
+		f = nullptr;
+		return !failed;
+	}
+
+private:
+	FILE* f;
+	std::size_t offset = 0;
+	bool failed = false;
+};
+
+// walks a mapped checkpoint, handing out pointers into the mapping instead of copies
+class CheckpointReader
+{
+public:
+	CheckpointReader(unsigned char* data, std::size_t size) : data(data), size(size) { }
+
+	// returns the next bytes in place, nullptr when the checkpoint is too short
+	unsigned char* Take(std::size_t bytes)
+	{
+		if (failed || size - offset < bytes)
+		{
+			failed = true;
+			return nullptr;
+		}
+		unsigned char* p = data + offset;
+		offset += bytes;
+		return p;
+	}
+
+	template<typename T>
+	bool Read(T& value)
+	{
+		unsigned char* p = Take(sizeof(T));
+		if (p != nullptr)
+			memcpy(&value, p, sizeof(T));
+		return p != nullptr;
+	}
+
+	void Align(std::size_t alignment)
+	{
+		if (offset % alignment != 0)
+			Take(alignment - offset % alignment);
+	}
+
+	bool Failed() const { return failed; }
+
+private:
+	unsigned char* data;
+	std::size_t size, offset = 0;
+	bool failed = false;
+};
+
+// Full state of a hierarchy and the simulated memory behind it, for warming once and measuring many times.
+// Restoring maps the file copy-on-write: memory pages are used in place and cache state is copied
+// straight out of the mapping, so the checkpoint must outlive every run that restored from it.
+// Stats counters are not part of the state, a restored hierarchy starts counting from where it was.
+class Checkpoint
+{
+public:
+	Checkpoint() { }
+	~Checkpoint() { Unmap(); }
+
+	// levels are listed from the first level down, data is optional: without it dirty lines are
+	// written through to memory first and every line is reloaded from memory on restore
+	static bool Save(const char* file, CacheBase** levels, int nrOfLevels, bool data = true);
+
+	// fails without touching the hierarchy if the file is missing or its geometry differs
+	bool Restore(const char* file, CacheBase** levels, int nrOfLevels);
+
+private:
+	unsigned char* view = nullptr;
+	std::size_t size = 0;
+	void* mapping = nullptr; // file mapping handle on Windows
+
+	bool Map(const char* file);
+	void Unmap();
+
+	Checkpoint(const Checkpoint&);
+	Checkpoint& operator=(const Checkpoint&);
+};
@@ -404,7 +404,7 @@ void StopMeasurement()
 
 int GetNrCounters() { return NumCounters; }
 char* GetCounterName( int idx ) { return MSRCounters.CounterNames[idx]; }
-int GetCounterValue( int idx ) { return PThreadData[idx + PMCResultsOS / sizeof( int )]; }
+long long GetCounterValue( int idx ) { return PThreadData[idx + PMCResultsOS / sizeof( int )]; }
 
 //////////////////////////////////////////////////////////////////////////////
 //        CMSRInOutQue class member functions
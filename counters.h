@@ -5,7 +5,11 @@ void StartMeasurement();
 void StopMeasurement();
 int GetNrCounters();
 char* GetCounterName( int idx );
-int GetCounterValue( int idx );
+long long GetCounterValue( int idx );
+
+// The rest drives the counters through the MSR driver on Windows, perfevent.cpp implements the
+// functions above with perf_event_open on Linux.
+#ifdef _WIN32
 
 // maximum number of threads. Must be 4 or 8.
 #if defined(_M_X64) || defined(__x86_64__) || defined(__amd64)
@@ -511,4 +515,6 @@ public:
 	int NumPMCs;                             // Number of general PMCs
 	int NumFixedPMCs;                        // Number of fixed function PMCs
 	int ProcessorNumber;                     // main thread processor number in multiprocessor systems
-};
\ No newline at end of file
+};
+
+#endif // _WIN32
@@ -0,0 +1,347 @@
+#pragma once
+#include <vector>
+#include "cache.h"
+
+// row buffer management after a column access
+enum PagePolicy
+{
+	OPENPAGE, // leave the row open, betting on the next access hitting it
+	CLOSEDPAGE // precharge right after the access
+};
+
+// order of the address fields from most to least significant bit, above the line offset
+enum AddressMapping
+{
+	ROW_RANK_BANK_CHANNEL_COLUMN, // consecutive lines share a row (page interleaving)
+	ROW_COLUMN_RANK_BANK_CHANNEL, // consecutive lines go to different channels and banks (line interleaving)
+	ROW_BANK_RANK_COLUMN_CHANNEL // channel interleaving per line, rows shared within a channel
+};
+
+// Defaults model dual channel DDR3-1600 11-11-11 with 2 ranks of 8 banks per channel.
+// Timings are in memory clock cycles, clockRatio converts them to core cycles.
+struct DRAMConfig
+{
+	int channels = 2, ranks = 2, banks = 8;
+	int rows = 32768, rowSize = 8192; // rows per bank and bytes per row
+	PagePolicy policy = OPENPAGE;
+	AddressMapping mapping = ROW_RANK_BANK_CHANNEL_COLUMN;
+	bool xorBanks = false; // permute bank index with the low row bits to spread row conflicts
+	int tCAS = 11, tRCD = 11, tRP = 11, tBurst = 4;
+	int busMHz = 800; // memory clock, used for the bandwidth figure
+	int clockRatio = 4; // core cycles per memory clock (3.5GHz core)
+	int queueDepth = 16; // requests waiting for a bank or the bus the FR-FCFS scheduler can choose from
+};
+
+// main memory back-end behind the last cache level
+class DRAM : public CacheBase
+{
+public:
+	std::uint64_t rowhits = 0, rowmisses = 0, rowconflicts = 0; // row buffer outcome per request
+	std::uint64_t bytes = 0, totalLatency = 0; // latency in memory cycles, from arrival to last data beat
+	std::uint64_t begin = 0, end = 0; // memory cycles of the last reset and of the latest data beat, for the bandwidth
+
+	DRAM(const DRAMConfig& c = DRAMConfig()) : config(c)
+	{
+		latency = (config.tRCD + config.tCAS + config.tBurst) * config.clockRatio; // nominal, for callers pricing single accesses
+		for (int i = LINESIZE; i != 1; i >>= 1, ++offsetBits);
+		columnBits = Log2(config.rowSize / LINESIZE);
+		channelBits = Log2(config.channels);
+		rankBits = Log2(config.ranks);
+		bankBits = Log2(config.banks);
+		rowBits = Log2(config.rows);
+		indexBits = columnBits + channelBits + rankBits + bankBits;
+
+		banks.resize(config.channels * config.ranks * config.banks);
+		busFree.resize(config.channels, 0);
+		queue.reserve(config.queueDepth);
+	}
+
+	// a line read or written back without any data, for tag-only hierarchies (pipeline.cpp)
+	void AccessTag(std::uintptr_t address, bool write)
+	{
+		(write ? writes : reads)++;
+		Enqueue(address);
+	}
+
+	// core cycles from the arrival to the last data beat of every scheduled request
+	std::uint64_t Cycles() const { return totalLatency * config.clockRatio; }
+
+	// schedule everything still waiting for a bank or the bus
+	void Drain()
+	{
+		while (!queue.empty())
+			Schedule(Pick());
+	}
+
+	// call Drain first, requests still in the queue have no row outcome or timing yet
+	void PrintStats() const
+	{
+		std::uint64_t requests = rowhits + rowmisses + rowconflicts;
+		std::cout << "Reads: " << reads << std::endl;
+		std::cout << "Writes: " << writes << std::endl;
+		std::cout << "Row hits: " << rowhits << std::endl;
+		std::cout << "Row misses: " << rowmisses << std::endl;
+		std::cout << "Row conflicts: " << rowconflicts << std::endl;
+		if (requests == 0)
+			return;
+
+		std::cout << "Row hit rate: " << 100.0 * rowhits / requests << "%" << std::endl;
+		std::uint64_t cycles = Cycles();
+		std::cout << "Average latency: " << (double)cycles / requests << " cycles" << std::endl;
+		std::cout << "Total cycles: " << cycles << " (" << cycles / CYCLESPERMILLISECOND << "ms)" << std::endl;
+		std::uint64_t elapsed = end > begin ? end - begin : 1;
+		double seconds = (double)elapsed / (config.busMHz * 1000000.0);
+		std::cout << "Bandwidth: " << bytes / seconds / 1000000000.0 << "GB/s over " << elapsed << " memory cycles" << std::endl;
+	}
+
+	// counters only, open rows and timing are part of the state
+	void ResetStats()
+	{
+		CacheBase::ResetStats();
+		Drain();
+		rowhits = rowmisses = rowconflicts = bytes = totalLatency = 0;
+		begin = end = Clock() / config.clockRatio;
+	}
+
+	// open rows and timing of every bank and channel and the requester's clock, the queue is drained first
+	void Save(CheckpointWriter& out, bool data)
+	{
+		Drain();
+		out.Write<std::uint32_t>(CHECKPOINTDRAM);
+		out.Write<std::uint32_t>((std::uint32_t)banks.size());
+		out.Write<std::uint32_t>((std::uint32_t)busFree.size());
+		out.Write<std::uint32_t>(0);
+		for (const Bank& bank : banks)
+		{
+			out.Write<std::int64_t>(bank.openRow);
+			out.Write(bank.ready);
+		}
+		for (std::uint64_t free : busFree)
+			out.Write(free);
+		out.Write(Clock());
+	}
+
+	bool Load(CheckpointReader& in, bool apply)
+	{
+		std::uint32_t kind = 0, nrOfBanks = 0, nrOfChannels = 0, unused = 0;
+		in.Read(kind), in.Read(nrOfBanks), in.Read(nrOfChannels), in.Read(unused);
+		if (in.Failed() || kind != CHECKPOINTDRAM || nrOfBanks != banks.size() || nrOfChannels != busFree.size())
+			return false;
+
+		std::vector<Bank> b(nrOfBanks);
+		std::vector<std::uint64_t> free(nrOfChannels);
+		std::uint64_t time = 0;
+		for (Bank& bank : b)
+		{
+			std::int64_t row = -1;
+			in.Read(row), in.Read(bank.ready);
+			bank.openRow = (int)row;
+		}
+		for (std::uint64_t& f : free)
+			in.Read(f);
+		in.Read(time);
+		if (in.Failed() || !apply)
+			return !in.Failed();
+
+		banks = b;
+		busFree = free;
+		Clock() = time;
+		begin = end = time / config.clockRatio;
+		queue.clear();
+		return true;
+	}
+
+private:
+	struct Request
+	{
+		std::uintptr_t address;
+		int channel, bank; // bank is the index into banks, over all channels and ranks
+		int row;
+		std::uint64_t arrival;
+	};
+
+	struct Bank
+	{
+		int openRow = -1; // -1 if precharged
+		std::uint64_t ready = 0; // first cycle a new command can be issued
+	};
+
+	DRAMConfig config;
+	int columnBits = 0, channelBits = 0, rankBits = 0, bankBits = 0, rowBits = 0;
+	std::vector<Bank> banks;
+	std::vector<std::uint64_t> busFree; // first cycle the data bus of each channel is free
+	std::vector<Request> queue; // in order of arrival
+
+	// get the line containing address, timing is accounted for when the request is scheduled
+	byte* ReadData(std::uintptr_t address)
+	{
+		reads++;
+		Enqueue(address);
+		return memory->Data(address - (address % LINESIZE));
+	}
+
+	// write back nrOfBytes at address
+	void WriteData(std::uintptr_t address, int nrOfBytes, byte* data)
+	{
+		writes++;
+		Enqueue(address);
+
+		memory->Write(address, nrOfBytes, data);
+	}
+
+	// functional warming leaves the row buffers and the queue alone
+	byte* WarmData(std::uintptr_t address)
+	{
+		return memory->Data(address - (address % LINESIZE));
+	}
+
+	void WarmWrite(std::uintptr_t address, int nrOfBytes, byte* data)
+	{
+		memory->Write(address, nrOfBytes, data);
+	}
+
+	// The request arrives at the requester's current time and the controller issues whatever it could
+	// have issued by then. Requests that still wait for their bank or the bus stay in the queue, where
+	// later arrivals can overtake them, until the queue is full.
+	void Enqueue(std::uintptr_t address)
+	{
+		Request r;
+		r.address = address;
+		r.arrival = Clock() / config.clockRatio;
+		Decode(address, r);
+		queue.push_back(r);
+		Clock() += latency;
+
+		while (!queue.empty())
+		{
+			int pick = Pick();
+			if (Start(queue[pick]) > r.arrival && (int)queue.size() < config.queueDepth)
+				break;
+			Schedule(pick);
+		}
+	}
+
+	// first cycle a command for r can be issued
+	std::uint64_t Start(const Request& r) const
+	{
+		std::uint64_t ready = banks[r.bank].ready;
+		return ready > r.arrival ? ready : r.arrival;
+	}
+
+	// FR-FCFS: of the requests that can go first, the oldest that hits an open row, otherwise the oldest
+	int Pick() const
+	{
+		std::uint64_t first = Start(queue[0]);
+		for (const Request& r : queue)
+			if (Start(r) < first)
+				first = Start(r);
+
+		int oldest = -1;
+		for (int i = 0; i < (int)queue.size(); ++i)
+			if (Start(queue[i]) == first)
+			{
+				if (banks[queue[i].bank].openRow == queue[i].row)
+					return i;
+				if (oldest < 0)
+					oldest = i;
+			}
+		return oldest;
+	}
+
+	// issue the commands of queue[pick] as soon as its bank and then its channel's data bus are ready
+	void Schedule(int pick)
+	{
+		Request r = queue[pick];
+		queue.erase(queue.begin() + pick);
+
+		Bank& bank = banks[r.bank];
+		std::uint64_t start = Start(r);
+		std::uint64_t column; // cycle at which the column command is issued
+		if (bank.openRow == r.row)
+		{
+			rowhits++;
+			column = start;
+		}
+		else if (bank.openRow == -1)
+		{
+			rowmisses++;
+			column = start + config.tRCD;
+		}
+		else
+		{
+			rowconflicts++;
+			column = start + config.tRP + config.tRCD;
+		}
+
+		std::uint64_t data = column + config.tCAS;
+		if (data < busFree[r.channel]) // wait for the data bus
+			data = busFree[r.channel];
+		std::uint64_t done = data + config.tBurst;
+		busFree[r.channel] = done;
+
+		// column commands to an open row can be pipelined one burst apart
+		bank.ready = column + config.tBurst;
+		if (config.policy == OPENPAGE)
+			bank.openRow = r.row;
+		else
+		{
+			bank.openRow = -1;
+			bank.ready += config.tRP;
+		}
+
+		if (done > end)
+			end = done;
+		bytes += LINESIZE;
+		totalLatency += done - r.arrival;
+	}
+
+	// split address into channel, bank and row according to the mapping
+	void Decode(std::uintptr_t address, Request& r) const
+	{
+		std::uintptr_t a = address >> offsetBits;
+		int channel = 0, rank = 0, bank = 0;
+		switch (config.mapping)
+		{
+		case ROW_RANK_BANK_CHANNEL_COLUMN:
+			a >>= columnBits;
+			channel = Take(a, channelBits);
+			bank = Take(a, bankBits);
+			rank = Take(a, rankBits);
+			break;
+		case ROW_COLUMN_RANK_BANK_CHANNEL:
+			channel = Take(a, channelBits);
+			bank = Take(a, bankBits);
+			rank = Take(a, rankBits);
+			a >>= columnBits;
+			break;
+		case ROW_BANK_RANK_COLUMN_CHANNEL:
+			channel = Take(a, channelBits);
+			a >>= columnBits;
+			rank = Take(a, rankBits);
+			bank = Take(a, bankBits);
+			break;
+		}
+		r.row = Take(a, rowBits);
+
+		if (config.xorBanks)
+			bank ^= r.row & (config.banks - 1);
+
+		r.channel = channel;
+		r.bank = (channel * config.ranks + rank) * config.banks + bank;
+	}
+
+	// remove the lowest bits from a and return them
+	static int Take(std::uintptr_t& a, int bits)
+	{
+		int value = (int)(a & ((std::uintptr_t(1) << bits) - 1));
+		a >>= bits;
+		return value;
+	}
+
+	static int Log2(int value)
+	{
+		int bits = 0;
+		for (; value > 1; value >>= 1, ++bits);
+		return bits;
+	}
+};
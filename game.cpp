@@ -1,113 +1,200 @@
 #include "precomp.h"
-#include "cache.h"
+#include "sim.h"
+#include "snapshot.h"
 #include <iostream>
 #include <string>
 
-// Based on Intel Core i7 4770K (Haswell) specs and Table 2-3 (page 35) of the
-// Intel 64 and IA-32 Architectures Optimization Reference Manual, September 2014
-// L3 set associativity found at http://www.cpu-world.com/CPUs/Core_i7/Intel-Core%20i7-4770K.html
-// L3 latency found at http://7-cpu.com/cpu/Haswell.html
-#define L1LATENCY 4
-#define L2LATENCY 12
-#define L3LATENCY 36
-#define RAMLATENCYCYCLES 36
-#define RAMLATENCTNANOSECONDS 57
+// -----------------------------------------------------------
+// Convert heights to gray pixels: CLAMP( v / 2, 0, 255 ) in
+// every color channel, 16 values per iteration
+// -----------------------------------------------------------
+static void GrayRow( const int* src, Pixel* dst, int n )
+{
+	int i = 0;
+	if (sizeof( Pixel ) == 4)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		for( ; i + 16 <= n; i += 16 )
+		{
+			__m128i a = _mm_srai_epi32( _mm_loadu_si128( (const __m128i*)(src + i) ), 1 );
+			__m128i b = _mm_srai_epi32( _mm_loadu_si128( (const __m128i*)(src + i + 4) ), 1 );
+			__m128i c = _mm_srai_epi32( _mm_loadu_si128( (const __m128i*)(src + i + 8) ), 1 );
+			__m128i d = _mm_srai_epi32( _mm_loadu_si128( (const __m128i*)(src + i + 12) ), 1 );
+			// saturating packs clamp to 0..255
+			__m128i gray = _mm_packus_epi16( _mm_packs_epi32( a, b ), _mm_packs_epi32( c, d ) );
+			// spread every byte g to the pixel 0x00gggggg
+			__m128i gg = _mm_unpacklo_epi8( gray, gray ), g0 = _mm_unpacklo_epi8( gray, zero );
+			_mm_storeu_si128( (__m128i*)(dst + i), _mm_unpacklo_epi16( gg, g0 ) );
+			_mm_storeu_si128( (__m128i*)(dst + i + 4), _mm_unpackhi_epi16( gg, g0 ) );
+			gg = _mm_unpackhi_epi8( gray, gray ), g0 = _mm_unpackhi_epi8( gray, zero );
+			_mm_storeu_si128( (__m128i*)(dst + i + 8), _mm_unpacklo_epi16( gg, g0 ) );
+			_mm_storeu_si128( (__m128i*)(dst + i + 12), _mm_unpackhi_epi16( gg, g0 ) );
+		}
+	}
+	for( ; i < n; i++ )
+	{
+		int c = CLAMP( src[i] / 2, 0, 255 );
+		dst[i] = c + (c << 8) + (c << 16);
+	}
+}
+
+#define READ_SIZE 2
 
+// -----------------------------------------------------------
+// Snapshots handed from the simulation thread to the render thread
+// -----------------------------------------------------------
+#define PUBLISHINTERVAL 1024 // subdivision tasks between snapshots
 
-Cache<2048, 16> l3(nullptr, L3LATENCY); // 2MB, 16-way set associative (latency 36 cycles, 8MB over 4 cores)
-Cache<512, 8> l2(&l3, L2LATENCY); // 256KB, 8-way set associative (fastest latency 12 cycles)
-Cache<64, 8> l1(&l2, L1LATENCY); // 32KB, 8-way set associative (fastest latency 4 cycles)
+TripleBuffer<int> mapSnapshot( 513 * 513 );
+SeqLock<SimStats> statsSnapshot;
+CacheBase* overlayLevels[] = { &l1, &l2, &l3 };
+TripleBuffer<std::uint16_t> occupancySnapshot( 2 * (64 + 512 + 2048) ); // valid and dirty lines per set, per level
 
-template<typename T>
-T READ(std::uintptr_t address)
+namespace Tmpl8 {
+class SimulationThread : public Thread
 {
-	return l1.ReadData<T>(address);
+public:
+	SimulationThread( Game* g ) : game( g ) {}
+	void run() { game->Simulate(); }
+private:
+	Game* game;
+};
 }
 
-template<typename T>
-void WRITE(std::uintptr_t address, T value)
+// -----------------------------------------------------------
+// Initialize the application
+// -----------------------------------------------------------
+void Game::Init()
 {
-	l1.WriteData(address, value);
+	SimInit();
+	screen->Clear( 0 );
+	terrain.Init();
+	SimWatchHeatmap( terrain.map.GetRawRow( 0 ), sizeof( int ), 513 * 513 );
+	worker = new SimulationThread( this );
+	worker->start();
 }
 
 // -----------------------------------------------------------
-// Map access
+// Stop the simulation thread, even if it is not done yet
 // -----------------------------------------------------------
-int Map::Get( int x, int y ) 
+void Game::Shutdown()
 {
-	return READ<int>(reinterpret_cast<std::uintptr_t>(&map[x + y * 513]));
+	if (!worker) return;
+	quit = true;
+	worker->stop();
+	delete worker;
+	worker = 0;
 }
 
-void Map::Set( int x, int y, int v )
+// -----------------------------------------------------------
+// Simulation thread: runs all subdivision tasks at full speed,
+// publishing the map and stats for the render thread
+// -----------------------------------------------------------
+void Game::Simulate()
 {
-	WRITE<int>(reinterpret_cast<std::uintptr_t>(&map[x + y * 513]), v);
+	timer t;
+	// only the subdivision is measured, visualization runs outside the region of interest
+	SimRoiBegin();
+	for( int i = 1; !quit && terrain.Step(); i++ )
+		if (i % PUBLISHINTERVAL == 0) Publish();
+	SimRoiEnd();
+	Publish();
+	if (quit) return;
+	std::cout << "Simulation time: " << t.elapsed() << "ms" << std::endl << std::endl;
+	PrintStats();
 }
 
-#define READ_SIZE 2
+void Game::Publish()
+{
+	memcpy( mapSnapshot.Back(), terrain.map.GetRawRow( 0 ), 513 * 513 * sizeof( int ) );
+	mapSnapshot.Publish();
+	std::uint16_t* occupancy = occupancySnapshot.Back();
+	for( int l = 0; l < 3; l++ )
+	{
+		overlayLevels[l]->Occupancy( occupancy, occupancy + overlayLevels[l]->sets );
+		occupancy += 2 * overlayLevels[l]->sets;
+	}
+	occupancySnapshot.Publish();
+	statsSnapshot.Write( SimSnapshotStats() );
+}
 
 // -----------------------------------------------------------
-// Initialize the application
+// Overlay: misses per map cell (L1 red, L2 green, L3 blue),
+// per set occupancy of every level (green clean, red dirty)
+// and live counters
 // -----------------------------------------------------------
-void Game::Init()
+void Game::DrawOverlay( Pixel* d, const SimStats& stats )
 {
-	screen->Clear( 0 );
-	// initialize recursion stack
-	map.Init();
-	taskPtr = 0;
-	Push( 0, 0, 512, 512, 256 );
+	int pitch = screen->GetWidth();
+	float scale[3];
+	for( int l = 0; l < 3; l++ ) scale[l] = heatmap.Most( l ) > 0 ? 1.0f / heatmap.Most( l ) : 0;
+	for( int y = 0; y < 513; y++ ) for( int x = 0; x < 513; x++ )
+	{
+		int cell = x + y * 513, c[3];
+		for( int l = 0; l < 3; l++ ) c[l] = (int)(255.0f * sqrtf( heatmap.Misses( l, cell ) * scale[l] ));
+		d[x + y * pitch] = (c[0] << 16) + (c[1] << 8) + c[2];
+	}
+	// occupancy strips along the bottom, every column averages the sets it covers
+	const std::uint16_t* occupancy = occupancySnapshot.Front();
+	char line[128];
+	for( int l = 0; l < 3; l++ )
+	{
+		int sets = overlayLevels[l]->sets, ways = overlayLevels[l]->ways, top = SCRHEIGHT - 40 + l * 13, width = SCRWIDTH - 24;
+		const std::uint16_t* valid = occupancy, *dirty = occupancy + sets;
+		occupancy += 2 * sets;
+		sprintf( line, "l%i", l + 1 );
+		screen->Print( line, 2, top + 3, 0xffffff );
+		for( int x = 0; x < width; x++ )
+		{
+			int first = x * sets / width, last = MAX( (x + 1) * sets / width, first + 1 ), v = 0, dl = 0;
+			for( int i = first; i < last; i++ ) v += valid[i], dl += dirty[i];
+			int lines = (last - first) * ways, hv = v * 12 / lines, hd = dl * 12 / lines;
+			for( int h = 0; h < 12; h++ )
+				screen->GetBuffer()[20 + x + (top + 11 - h) * pitch] = h < hd ? 0xff0000 : h < hv ? 0x00c000 : 0x202020;
+		}
+	}
+	// counters for every level along the top
+	screen->Bar( 0, 0, SCRWIDTH - 1, 32, 0 );
+	for( int l = 0; l < 3; l++ )
+	{
+		const SimLevelStats& s = stats.levels[l];
+		std::uint64_t accesses = s.reads + s.writes, misses = s.readmisses + s.writemisses;
+		sprintf( line, "l%i accesses: %llu misses: %llu (%.2f pct) evictions: %llu", l + 1, (unsigned long long)accesses,
+			(unsigned long long)misses, accesses ? 100.0 * misses / accesses : 0.0, (unsigned long long)(s.cleanevicts + s.dirtyevicts) );
+		screen->Print( line, 2, 2 + l * 10, 0xffffff );
+	}
 }
 
 // -----------------------------------------------------------
-// Recursive subdivision
+// Tab switches between the terrain and the overlay
 // -----------------------------------------------------------
-void Game::Subdivide( int x1, int y1, int x2, int y2, int scale )
+void Game::KeyDown( int _Key )
 {
-	// termination
-	if ((x2 - x1) == 1) return;
-	// calculate diamond vertex positions
-	int cx = (x1 + x2) / 2, cy = (y1 + y2) / 2;
-	// set vertices
-	if (map.Get( cx, y1 ) == 0) map.Set( cx, y1, (map.Get( x1, y1 ) + map.Get( x2, y1 )) / 2 + IRand( scale ) - scale / 2 );
-	if (map.Get( cx, y2 ) == 0) map.Set( cx, y2, (map.Get( x1, y2 ) + map.Get( x2, y2 )) / 2 + IRand( scale ) - scale / 2 );
-	if (map.Get( x1, cy ) == 0) map.Set( x1, cy, (map.Get( x1, y1 ) + map.Get( x1, y2 )) / 2 + IRand( scale ) - scale / 2 );
-	if (map.Get( x2, cy ) == 0) map.Set( x2, cy, (map.Get( x2, y1 ) + map.Get( x2, y2 )) / 2 + IRand( scale ) - scale / 2 );
-	if (map.Get( cx, cy ) == 0) map.Set( cx, cy, (map.Get( x1, y1 ) + map.Get( x2, y2 )) / 2 + IRand( scale ) - scale / 2 );
-	// push new tasks
-	Push( x1, y1, cx, cy, scale / 2 );
-	Push( cx, y1, x2, cy, scale / 2 );
-	Push( x1, cy, cx, y2, scale / 2 );
-	Push( cx, cy, x2, y2, scale / 2 );
+	if (_Key == SDL_SCANCODE_TAB) overlay = !overlay;
 }
 
-bool printed = false;
 // -----------------------------------------------------------
-// Main application tick function
+// Main application tick function: draws the latest snapshot
 // -----------------------------------------------------------
 void Game::Tick( float _DT )
 {
-	for( int i = 0; i < 1024; i++ )
-	{
-		// execute one subdivision task
-		if (taskPtr == 0)
-		{
-			if (!printed)
-			{
-				PrintStats();
-				printed = true;
-			}
-			break;
-		}
-		int x1 = task[--taskPtr].x1, x2 = task[taskPtr].x2;
-		int y1 = task[taskPtr].y1, y2 = task[taskPtr].y2;
-		Subdivide( x1, y1, x2, y2, task[taskPtr].scale );
-	}
 	// visualize
 	Pixel* d = screen->GetBuffer() + (SCRWIDTH - 513) / 2 + ((SCRHEIGHT - 513) / 2) * screen->GetWidth();
-	for( int y = 0; y < 513; y++ ) for( int x = 0; x < 513; x++ )
+	SimStats stats = statsSnapshot.Read();
+	if (overlay)
 	{
-		int c = CLAMP( map.Get( x, y ) / 2, 0, 255 );
-		d[x + y * screen->GetWidth()] = c + (c << 8) + (c << 16);
+		DrawOverlay( d, stats );
+		return;
 	}
+	screen->Clear( 0 );
+	const int* heights = mapSnapshot.Front();
+	for( int y = 0; y < 513; y++ ) GrayRow( heights + y * 513, d + y * screen->GetWidth(), 513 );
+	const SimLevelStats& l1stats = stats.levels[0];
+	std::uint64_t accesses = l1stats.reads + l1stats.writes, misses = l1stats.readmisses + l1stats.writemisses;
+	char line[128];
+	sprintf( line, "L1 accesses: %llu  misses: %llu", (unsigned long long)accesses, (unsigned long long)misses );
+	screen->Bar( 2, 2, 400, 10, 0 );
+	screen->Print( line, 2, 2, 0xffffff );
 }
 
 // -----------------------------------------------------------
@@ -115,17 +202,5 @@ void Game::Tick( float _DT )
 // -----------------------------------------------------------
 void Game::PrintStats()
 {
-	std::cout << "L1 cache stats" << std::endl;
-	l1.PrintStats();
-	std::cout << std::endl;
-	std::cout << "L2 cache stats" << std::endl;
-	l2.PrintStats();
-	std::cout << std::endl;
-	std::cout << "L3 cache stats" << std::endl;
-	l3.PrintStats();
-	std::cout << std::endl;
-	//ram
-	double latencyfromcycles = (l3.readmisses + l3.writemisses)*RAMLATENCYCYCLES / (double)CYCLESPERMILLISECOND;
-	double latencyfromns = RAMLATENCTNANOSECONDS * (l3.readmisses + l3.writemisses) / 1000000.0;
-	std::cout << "RAM latency: " << latencyfromcycles +latencyfromns << "ms"<<std::endl;
+	SimPrintStats();
 }
\ No newline at end of file
@@ -1,67 +1,36 @@
 #pragma once
+#include "terrain.h"
 
-namespace Tmpl8 {
+struct SimStats;
 
-struct Task
-{
-	int x1, y1, x2, y2, scale;
-};
-
-class Map
-{
-public:
-	Map()
-	{
-		int size = 513 * 513;
-		if (size % LINESIZE > 0) // pad to multiple of LINESIZE
-		{
-			size -= size % LINESIZE;
-			size += LINESIZE;
-		}
-		map = new int[size];
-	}
-	void Init()
-	{
-		memset( map, 0, 513 * 513 * sizeof( int ) );
-		Set( 0, 0, IRand( 256 ) );
-		Set( 512, 0, IRand( 256 ) );
-		Set( 0, 512, IRand( 256 ) );
-		Set( 512, 512, IRand( 256 ) );
-	}
-	int Get( int x, int y );
-	void Set( int x, int y, int v );
-private:
-	int* map;
-};
+namespace Tmpl8 {
 
 class Surface;
+class SimulationThread;
 class Game
 {
 public:
 	void SetTarget( Surface* _Surface ) { screen = _Surface; }
 	void Init();
-	void Shutdown() {};
-	void Push( int x1, int y1, int x2, int y2, int scale )
-	{
-		task[taskPtr].x1 = x1, task[taskPtr].x2 = x2;
-		task[taskPtr].y1 = y1, task[taskPtr].y2 = y2;
-		task[taskPtr++].scale = scale;
-	}
+	void Shutdown();
 	void GetMap( int x, int y );
 	void SetMap( int x, int y );
-	void Subdivide( int x1, int y1, int x2, int y2, int scale );
+	void Simulate();
+	void Publish();
 	void Tick( float _DT );
+	void DrawOverlay( Pixel* d, const SimStats& stats );
 	void MouseUp( int _Button ) { /* implement if you want to detect mouse button presses */ }
 	void MouseDown( int _Button ) { /* implement if you want to detect mouse button presses */ }
 	void MouseMove( int _X, int _Y ) { /* implement if you want to detect mouse movement */ }
 	void KeyUp( int _Key ) { /* implement if you want to handle keys */ }
-	void KeyDown( int _Key ) { /* implement if you want to handle keys */ }
+	void KeyDown( int _Key );
 	void PrintStats();
 private:
 	Surface* screen;
-	Map map;
-	Task task[512];
-	int taskPtr;
+	Terrain terrain;
+	SimulationThread* worker = 0;
+	std::atomic<bool> quit { false }; // set by the render thread to stop the simulation
+	bool overlay = false; // show cache behavior instead of the terrain
 };
 
 }; // namespace Tmpl8
\ No newline at end of file
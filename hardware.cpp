@@ -0,0 +1,109 @@
+#include "hardware.h"
+#include "counters.h"
+#include "regress.h"
+#include "sim.h"
+#include <stdio.h>
+#include <string.h>
+#include <memory>
+
+#define EVICTBYTES (64 * 1024 * 1024) // streamed through before measuring, to push the pattern out of a host LLC
+
+// the accesses as offsets into the host buffer, bit 0 set for writes (they are 4 byte aligned)
+static std::vector<std::uint32_t> Compact(const std::vector<TraceRecord>& accesses)
+{
+	std::vector<std::uint32_t> ops(accesses.size());
+	for (std::size_t i = 0; i < accesses.size(); ++i)
+		ops[i] = (std::uint32_t)(accesses[i].address - PATTERNBASE) | accesses[i].write;
+	return ops;
+}
+
+// volatile keeps every access and its order, the sum keeps the reads
+static std::uint64_t RunNative(const std::vector<std::uint32_t>& ops, byte* buffer)
+{
+	std::uint64_t sum = 0;
+	for (std::uint32_t op : ops)
+	{
+		volatile std::uint32_t* p = (volatile std::uint32_t*)(buffer + (op & ~3u));
+		if (op & 1) *p = (std::uint32_t)sum;
+		else sum += *p;
+	}
+	return sum;
+}
+
+// the chain holds offsets of the next line, every load depends on the one before
+static std::uint64_t ChaseNative(std::uint64_t n, byte* buffer)
+{
+	std::uint64_t offset = 0;
+	for (std::uint64_t i = 0; i < n; ++i)
+		offset = *(volatile std::uint64_t*)(buffer + offset);
+	return offset;
+}
+
+static void Row(const char* name, const char* hardwareName, std::uint64_t simulated)
+{
+	for (int i = 0; i < GetNrCounters(); ++i)
+		if (strcmp(GetCounterName(i), hardwareName) == 0)
+		{
+			long long hardware = GetCounterValue(i);
+			printf("%-12s %14lld %14llu %9.2f\n", name, hardware, (unsigned long long)simulated, hardware > 0 ? (double)simulated / hardware : 0.0);
+			return;
+		}
+	printf("%-12s %14s %14llu\n", name, "n/a", (unsigned long long)simulated);
+}
+
+void CompareWithHardware(PatternKind kind, std::uint64_t n, std::uint64_t seed)
+{
+	Workload w = Generate(kind, n, seed);
+	std::vector<TraceRecord> accesses = kind == PATTERNCHASE ? Flatten(w, n) : w.accesses;
+
+	// page aligned like PATTERNBASE, written once so page faults stay out of the measurement
+	std::unique_ptr<byte[]> storage(new byte[PATTERNWORKINGSET + 4096]);
+	byte* buffer = (byte*)(((std::uintptr_t)storage.get() + 4095) & ~(std::uintptr_t)4095);
+	memset(buffer, 0, PATTERNWORKINGSET);
+	for (std::size_t i = 0; i < w.chain.size(); ++i)
+		*(std::uint64_t*)(buffer + i * LINESIZE) = w.chain[i] - PATTERNBASE;
+	std::vector<std::uint32_t> ops = Compact(accesses);
+	std::unique_ptr<byte[]> evict(new byte[EVICTBYTES]);
+	memset(evict.get(), 1, EVICTBYTES);
+
+	InitPerformanceCounters();
+	std::uint64_t sum = 0;
+	for (std::size_t i = 0; i < EVICTBYTES; i += LINESIZE)
+		sum += evict[i];
+	StartMeasurement();
+	sum += kind == PATTERNCHASE ? ChaseNative(n, buffer) : RunNative(ops, buffer);
+	StopMeasurement();
+
+	// the hardware events count demand loads, so count the levels every load missed in, without the
+	// fills of store misses and write backs that readmisses includes
+	std::uint64_t loadMisses[3] = {};
+	ResetHierarchy();
+	SimRoiBegin();
+	for (const TraceRecord& a : accesses)
+	{
+		if (a.write)
+		{
+			SimWrite<std::uint32_t>(a.address, (std::uint32_t)sum);
+			continue;
+		}
+		sum += a.size == 8 ? SimRead<std::uint64_t>(a.address) : SimRead<std::uint32_t>(a.address);
+		for (int level = CacheBase::MissDepth(); level > 0; --level)
+			loadMisses[level - 1]++;
+	}
+	SimRoiEnd();
+
+	printf("%s, %llu accesses, seed %llu (checksum %llx)\n", w.name, (unsigned long long)n, (unsigned long long)seed, (unsigned long long)sum);
+	printf("%-12s %14s %14s %9s\n", "", "hardware", "simulated", "sim/hw");
+	Row("L1D misses", "L1D Miss", loadMisses[0]);
+	Row("L2 misses", "L2 Miss", loadMisses[1]);
+	Row("LLC misses", "LLC Miss", loadMisses[2]);
+#ifdef SIMULATETLB
+	Row("dTLB misses", "dTLBMiss", mmu.dtlbmisses);
+#endif
+	Row("cycles", "Core cyc", SimCycles());
+	if (GetNrCounters() == 0)
+		printf("Hardware counters unavailable, only simulated counts shown\n");
+	else
+		printf("Hardware counts include prefetches and the pattern's own loop, the simulator has no prefetcher\n");
+	ResetHierarchy();
+}
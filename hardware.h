@@ -0,0 +1,10 @@
+#pragma once
+#include "patterns.h"
+
+#define HWACCESSES (1 << 22) // default length of a compared pattern
+
+// Validation against the host: runs n accesses of a synthetic pattern natively on a host buffer with the
+// hardware counters of counters.h around it, then the same accesses through the simulated hierarchy from
+// empty caches, and prints both side by side. Without hardware counters only the simulated counts are
+// printed.
+void CompareWithHardware(PatternKind kind, std::uint64_t n, std::uint64_t seed);
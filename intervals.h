@@ -0,0 +1,156 @@
+#pragma once
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "sim.h"
+
+#define INTERVALWRITERSLEEP 10 // milliseconds between writer passes over the ring
+
+// what the interval length is counted in
+enum IntervalUnit
+{
+	INTERVALACCESSES, // accesses simulated in detail
+	INTERVALCYCLES // simulated cycles, as in PrintStats
+};
+
+// running totals at the end of an interval
+struct IntervalSample
+{
+	std::uint64_t accesses, cycles;
+	SimStats stats;
+};
+
+// Preallocated ring of interval samples, filled by the simulation thread and streamed to a CSV or JSON file
+// by a background writer. Pushing never blocks: when the writer falls behind samples are dropped and counted.
+// Samples hold running totals, the writer turns them into counts per interval.
+class IntervalLog
+{
+public:
+	std::uint64_t dropped = 0;
+
+	IntervalLog(int capacity = 4096) : ring(capacity), head(0), tail(0), stopping(false) { }
+	~IntervalLog() { Stop(); }
+
+	// open file (JSON if its name ends in .json, CSV otherwise) and start the writer
+	bool Start(const char* file)
+	{
+		Stop();
+		f = fopen(file, "w");
+		if (f == nullptr)
+			return false;
+
+		std::size_t length = strlen(file);
+		json = length >= 5 && strcmp(file + length - 5, ".json") == 0;
+		memset(&previous, 0, sizeof(previous));
+		written = 0;
+		if (json)
+			fprintf(f, "[\n");
+		else
+		{
+			fprintf(f, "interval,accesses,cycles");
+			const char* names[] = { "l1", "l2", "l3", "ram" };
+			for (const char* name : names)
+				fprintf(f, ",%s_reads,%s_writes,%s_readmisses,%s_writemisses,%s_cleanevicts,%s_dirtyevicts", name, name, name, name, name, name);
+			fprintf(f, ",translations,walks\n");
+		}
+
+		stopping = false;
+		writer = std::thread(&IntervalLog::Run, this);
+		return true;
+	}
+
+	// simulation thread only
+	void Push(const IntervalSample& sample)
+	{
+		std::uint64_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) == ring.size())
+		{
+			dropped++;
+			return;
+		}
+		ring[h % ring.size()] = sample;
+		head.store(h + 1, std::memory_order_release);
+	}
+
+	// write whatever is left and close the file
+	void Stop()
+	{
+		if (!writer.joinable())
+			return;
+
+		stopping = true;
+		writer.join();
+		if (json)
+			fprintf(f, "\n]\n");
+		fclose(f);
+		f = nullptr;
+	}
+
+private:
+	std::vector<IntervalSample> ring;
+	std::atomic<std::uint64_t> head, tail; // samples pushed and written so far
+	std::atomic<bool> stopping;
+	std::thread writer;
+	FILE* f = nullptr;
+	bool json = false;
+	IntervalSample previous; // last sample written
+	std::uint64_t written = 0;
+
+	void Run()
+	{
+		while (!stopping)
+		{
+			Drain();
+			std::this_thread::sleep_for(std::chrono::milliseconds(INTERVALWRITERSLEEP));
+		}
+		Drain();
+	}
+
+	void Drain()
+	{
+		std::uint64_t t = tail.load(std::memory_order_relaxed), h = head.load(std::memory_order_acquire);
+		for (; t < h; ++t)
+		{
+			Write(ring[t % ring.size()]);
+			tail.store(t + 1, std::memory_order_release);
+		}
+		fflush(f);
+	}
+
+	// counters since the previous sample, or since a reset if they went down
+	static unsigned long long Delta(std::uint64_t current, std::uint64_t before)
+	{
+		return current >= before ? current - before : current;
+	}
+
+	void Write(const IntervalSample& s)
+	{
+		const char* separator = written > 0 ? ",\n" : "";
+		if (json)
+			fprintf(f, "%s{\"interval\":%llu,\"accesses\":%llu,\"cycles\":%llu,\"levels\":[", separator, (unsigned long long)written, Delta(s.accesses, previous.accesses), Delta(s.cycles, previous.cycles));
+		else
+			fprintf(f, "%llu,%llu,%llu", (unsigned long long)written, Delta(s.accesses, previous.accesses), Delta(s.cycles, previous.cycles));
+
+		for (int l = 0; l < 4; ++l)
+		{
+			const SimLevelStats& c = s.stats.levels[l], &p = previous.stats.levels[l];
+			if (json)
+				fprintf(f, "%s{\"reads\":%llu,\"writes\":%llu,\"readmisses\":%llu,\"writemisses\":%llu,\"cleanevicts\":%llu,\"dirtyevicts\":%llu}", l > 0 ? "," : "",
+					Delta(c.reads, p.reads), Delta(c.writes, p.writes), Delta(c.readmisses, p.readmisses), Delta(c.writemisses, p.writemisses), Delta(c.cleanevicts, p.cleanevicts), Delta(c.dirtyevicts, p.dirtyevicts));
+			else
+				fprintf(f, ",%llu,%llu,%llu,%llu,%llu,%llu", Delta(c.reads, p.reads), Delta(c.writes, p.writes), Delta(c.readmisses, p.readmisses), Delta(c.writemisses, p.writemisses), Delta(c.cleanevicts, p.cleanevicts), Delta(c.dirtyevicts, p.dirtyevicts));
+		}
+
+		unsigned long long translations = Delta(s.stats.translations, previous.stats.translations), walks = Delta(s.stats.walks, previous.stats.walks);
+		if (json)
+			fprintf(f, "],\"translations\":%llu,\"walks\":%llu}", translations, walks);
+		else
+			fprintf(f, ",%llu,%llu\n", translations, walks);
+
+		previous = s;
+		written++;
+	}
+};
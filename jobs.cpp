@@ -0,0 +1,239 @@
+#include "jobs.h"
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace Tmpl8;
+
+static thread_local int workerIndex = -1; // of the calling thread in the pool, -1 outside it
+
+void Job::RunCodeWrapper()
+{
+	Main();
+}
+
+// -----------------------------------------------------------
+// Chase-Lev deque, with the memory orders of Le et al., "Correct and Efficient
+// Work-Stealing for Weak Memory Models" but a release store instead of the release fence in Push
+// -----------------------------------------------------------
+void WorkDeque::Push(Job* job)
+{
+	std::int64_t b = bottom.load(std::memory_order_relaxed), t = top.load(std::memory_order_acquire);
+	Array* a = array.load(std::memory_order_relaxed);
+	if (b - t > a->size - 1) // full, copy to an array twice the size
+	{
+		Array* grown = new Array(a->size * 2);
+		for (std::int64_t i = t; i < b; ++i)
+			grown->Put(i, a->Get(i));
+		arrays.emplace_back(grown);
+		array.store(grown, std::memory_order_release);
+		a = grown;
+	}
+	a->Put(b, job);
+	bottom.store(b + 1, std::memory_order_release); // publishes the job and the array to thieves
+}
+
+Job* WorkDeque::Take()
+{
+	std::int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+	Array* a = array.load(std::memory_order_relaxed);
+	bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	std::int64_t t = top.load(std::memory_order_relaxed);
+	if (t > b) // empty
+	{
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+	Job* job = a->Get(b);
+	if (t == b) // the last job, race the thieves for it
+	{
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			job = nullptr;
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+Job* WorkDeque::Steal()
+{
+	std::int64_t t = top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	std::int64_t b = bottom.load(std::memory_order_acquire);
+	if (t >= b)
+		return nullptr;
+	Job* job = array.load(std::memory_order_acquire)->Get(t);
+	if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return nullptr; // another thief or the owner was first
+	return job;
+}
+
+// -----------------------------------------------------------
+// Job manager
+// -----------------------------------------------------------
+JobManager* JobManager::jobManager = 0;
+
+JobManager::JobManager(unsigned int threads, bool pin) : numThreads(threads), deques(new WorkDeque[threads])
+{
+	for (unsigned int i = 0; i < numThreads; i++)
+		workers.emplace_back(&JobManager::Worker, this, i, pin);
+}
+
+JobManager::~JobManager()
+{
+	quit.store(true);
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		wake.notify_all();
+	}
+	for (std::thread& w : workers)
+		w.join();
+	if (jobManager == this)
+		jobManager = 0;
+}
+
+void JobManager::CreateJobManager(unsigned int numThreads, bool pin)
+{
+	delete jobManager;
+	jobManager = new JobManager(numThreads > 0 ? numThreads : 1, pin);
+}
+
+void JobManager::AddJob2(Job* job)
+{
+	added.push_back(job);
+}
+
+void JobManager::RunJobs()
+{
+	JobGroup group;
+	std::vector<Job*> jobs;
+	jobs.swap(added);
+	for (Job* job : jobs)
+		Spawn(job, group);
+	Wait(group);
+}
+
+void JobManager::Spawn(Job* job, JobGroup& group)
+{
+	job->group = &group;
+	group.pending.fetch_add(1, std::memory_order_relaxed);
+	if (workerIndex >= 0 && jobManager == this)
+		deques[workerIndex].Push(job);
+	else
+	{
+		std::lock_guard<std::mutex> guard(injectLock);
+		injected.push_back(job);
+		injectedCount.fetch_add(1, std::memory_order_release);
+	}
+	// with the fence in Worker either this sees the sleeper or the sleeper sees the job, and the
+	// lock makes the notify wait until the sleeper is waiting
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (sleeping.load(std::memory_order_relaxed) > 0)
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		wake.notify_one();
+	}
+}
+
+void JobManager::Wait(JobGroup& group)
+{
+	int self = jobManager == this ? workerIndex : -1;
+	std::uint32_t seed = 0x9e3779b9u + (std::uint32_t)(self + 1);
+	while (group.pending.load(std::memory_order_acquire) > 0)
+	{
+		Job* job = FindJob(self, seed);
+		if (job != nullptr) Run(job);
+		else std::this_thread::yield();
+	}
+}
+
+void JobManager::Run(Job* job)
+{
+	JobGroup* group = job->group; // job may be gone once its group is done
+	job->RunCodeWrapper();
+	group->pending.fetch_sub(1, std::memory_order_release);
+}
+
+// any job queued anywhere, for a worker about to sleep
+bool JobManager::HasWork()
+{
+	if (injectedCount.load(std::memory_order_relaxed) > 0)
+		return true;
+	for (unsigned int i = 0; i < numThreads; ++i)
+		if (!deques[i].Empty())
+			return true;
+	return false;
+}
+
+// own deque first, then the injected jobs, then steal from a random worker onwards
+Job* JobManager::FindJob(int self, std::uint32_t& seed)
+{
+	Job* job = self >= 0 ? deques[self].Take() : nullptr;
+	if (job != nullptr)
+		return job;
+	if (injectedCount.load(std::memory_order_acquire) > 0)
+	{
+		std::lock_guard<std::mutex> guard(injectLock);
+		if (!injected.empty())
+		{
+			job = injected.front();
+			injected.pop_front();
+			injectedCount.fetch_sub(1, std::memory_order_relaxed);
+			return job;
+		}
+	}
+	seed ^= seed << 13, seed ^= seed >> 17, seed ^= seed << 5;
+	for (unsigned int i = 0, victim = seed % numThreads; i < numThreads; ++i, victim = (victim + 1) % numThreads)
+		if ((int)victim != self && (job = deques[victim].Steal()) != nullptr)
+			return job;
+	return nullptr;
+}
+
+static void PinToCore(unsigned int core)
+{
+#ifdef _WIN32
+	SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << (core % (8 * sizeof(DWORD_PTR))));
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core % CPU_SETSIZE, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+	(void)core; // no affinity API, the threads float
+#endif
+}
+
+void JobManager::Worker(unsigned int index, bool pin)
+{
+	workerIndex = (int)index;
+	if (pin)
+		PinToCore(index);
+	std::uint32_t seed = 0x9e3779b9u * (index + 1);
+	int idle = 0;
+	while (!quit.load(std::memory_order_relaxed))
+	{
+		Job* job = FindJob((int)index, seed);
+		if (job != nullptr)
+		{
+			Run(job);
+			idle = 0;
+			continue;
+		}
+		if (++idle < 64) // spin a little before going to sleep, jobs often come in bursts
+		{
+			std::this_thread::yield();
+			continue;
+		}
+		// a job spawned after this looks for work sees sleeping and notifies, see Spawn
+		std::unique_lock<std::mutex> guard(sleepLock);
+		sleeping.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (!quit.load() && !HasWork())
+			wake.wait(guard);
+		sleeping.fetch_sub(1, std::memory_order_relaxed);
+		idle = 0;
+	}
+}
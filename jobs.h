@@ -0,0 +1,151 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing job system on std::thread. Every worker owns a Chase-Lev deque: it pushes and takes
+// jobs at the bottom without locking, idle workers steal from the top of the others. Jobs spawned from
+// outside the pool go through one locked queue, which is why ParallelFor hands the pool a single job
+// that splits itself. A thread waiting for a group of jobs runs jobs itself until the group is done.
+
+namespace Tmpl8 {
+
+class JobManager;
+
+// jobs spawned together, Wait returns when all of them are done
+struct JobGroup
+{
+	std::atomic<int> pending{ 0 };
+};
+
+class Job
+{
+public:
+	virtual ~Job() { }
+	virtual void Main() = 0;
+protected:
+	friend class JobManager;
+	JobGroup* group = nullptr;
+	void RunCodeWrapper();
+};
+
+// Chase-Lev deque of jobs: the owner pushes and takes at the bottom, other threads steal from the top.
+// The array doubles when full, old arrays are kept until the deque goes away since a thief may still read them.
+class WorkDeque
+{
+public:
+	WorkDeque() { arrays.emplace_back(new Array(64)); array.store(arrays.back().get(), std::memory_order_relaxed); }
+	void Push(Job* job); // owner only
+	Job* Take(); // owner only, newest first
+	Job* Steal(); // any thread, oldest first
+	bool Empty() const { return top.load(std::memory_order_relaxed) >= bottom.load(std::memory_order_relaxed); } // any thread, a hint
+
+private:
+	struct Array
+	{
+		std::int64_t size;
+		std::unique_ptr<std::atomic<Job*>[]> slots;
+		Array(std::int64_t n) : size(n), slots(new std::atomic<Job*>[n]) { }
+		Job* Get(std::int64_t i) const { return slots[i & (size - 1)].load(std::memory_order_relaxed); }
+		void Put(std::int64_t i, Job* job) { slots[i & (size - 1)].store(job, std::memory_order_relaxed); }
+	};
+
+	alignas(64) std::atomic<std::int64_t> top{ 0 };
+	alignas(64) std::atomic<std::int64_t> bottom{ 0 };
+	std::atomic<Array*> array;
+	std::vector<std::unique_ptr<Array>> arrays; // every array ever used, the owner only adds to it
+};
+
+class JobManager // singleton class!
+{
+protected:
+	JobManager(unsigned int numThreads, bool pin);
+public:
+	~JobManager();
+	// start numThreads workers, pinned to cores 0 to numThreads - 1 if pin is set
+	static void CreateJobManager(unsigned int numThreads, bool pin = false);
+	static JobManager* GetJobManager() { return jobManager; }
+	// queue a job for the next RunJobs, any number of them
+	void AddJob2(Job* job);
+	unsigned int GetNumThreads() { return numThreads; }
+	// run every job added since the last call and wait for them
+	void RunJobs();
+	int MaxConcurrent() { return numThreads; }
+
+	// fork: start job as part of group, from a job or from outside the pool
+	void Spawn(Job* job, JobGroup& group);
+	// join: run jobs until every job of group is done
+	void Wait(JobGroup& group);
+
+	// body(i) for every i in [begin, end), in chunks of grain indices that the workers split between them
+	template<typename F>
+	void ParallelFor(int begin, int end, F body, int grain = 1);
+
+private:
+	static JobManager* jobManager;
+	unsigned int numThreads;
+	std::unique_ptr<WorkDeque[]> deques; // one per worker
+	std::vector<std::thread> workers;
+	std::vector<Job*> added; // by AddJob2, for RunJobs
+	std::mutex injectLock; // guards injected
+	std::deque<Job*> injected; // spawned from outside the pool
+	std::atomic<int> injectedCount{ 0 };
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	std::atomic<int> sleeping{ 0 };
+	std::atomic<bool> quit{ false };
+
+	void Worker(unsigned int index, bool pin);
+	bool HasWork();
+	Job* FindJob(int self, std::uint32_t& seed);
+	void Run(Job* job);
+};
+
+// Chunk k of a ParallelFor covers indices [begin + k * grain, begin + (k + 1) * grain). A job owns a run
+// of chunks [first, last) and keeps handing the upper half to the pool until it holds one chunk, so the
+// pool gets one job from outside and the rest is spread by stealing.
+template<typename F>
+void JobManager::ParallelFor(int begin, int end, F body, int grain)
+{
+	if (end <= begin)
+		return;
+	if (grain < 1)
+		grain = 1;
+
+	struct Chunks : Job
+	{
+		std::vector<Chunks>* all;
+		F* body;
+		JobGroup* parallelGroup;
+		int begin, end, grain, first, last;
+		void Main()
+		{
+			while (last - first > 1)
+			{
+				int mid = (first + last) / 2;
+				Chunks& upper = (*all)[mid];
+				upper.first = mid, upper.last = last;
+				last = mid;
+				JobManager::GetJobManager()->Spawn(&upper, *parallelGroup);
+			}
+			int from = begin + first * grain, to = end - from > grain ? from + grain : end;
+			for (int i = from; i < to; ++i)
+				(*body)(i);
+		}
+	};
+
+	JobGroup done;
+	std::vector<Chunks> chunks((end - begin + grain - 1) / grain);
+	for (Chunks& c : chunks)
+		c.all = &chunks, c.body = &body, c.parallelGroup = &done, c.begin = begin, c.end = end, c.grain = grain;
+	chunks[0].first = 0, chunks[0].last = (int)chunks.size();
+	Spawn(&chunks[0], done);
+	Wait(done);
+}
+
+}; // namespace Tmpl8
@@ -0,0 +1,137 @@
+#include "jobs.h"
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// Checks of the job system (make jobtest): RunJobs, nested ParallelFor, fork/join and waking sleeping
+// workers, each on pools of 1 to 8 workers. Prints every case and returns the number that failed.
+
+using namespace Tmpl8;
+
+class CountJob : public Job
+{
+public:
+	std::atomic<int>* count = nullptr;
+	void Main() { count->fetch_add(1, std::memory_order_relaxed); }
+};
+
+// every job added since the last RunJobs runs exactly once, over several rounds
+static bool TestRunJobs()
+{
+	std::atomic<int> count{ 0 };
+	std::vector<CountJob> jobs(1000);
+	for (int round = 1; round <= 3; ++round)
+	{
+		for (CountJob& j : jobs)
+		{
+			j.count = &count;
+			JobManager::GetJobManager()->AddJob2(&j);
+		}
+		JobManager::GetJobManager()->RunJobs();
+		if (count.load() != round * (int)jobs.size())
+			return false;
+	}
+	return true;
+}
+
+// a ParallelFor inside every index of another one covers every pair once, with odd grains
+static bool TestNestedParallelFor()
+{
+	const int outer = 37, inner = 101;
+	std::vector<std::atomic<int>> hits(outer * inner);
+	for (std::atomic<int>& h : hits)
+		h.store(0);
+	JobManager::GetJobManager()->ParallelFor(0, outer, [&](int i)
+	{
+		JobManager::GetJobManager()->ParallelFor(0, inner, [&](int j) { hits[i * inner + j].fetch_add(1); }, 7);
+	}, 3);
+	for (const std::atomic<int>& h : hits)
+		if (h.load() != 1)
+			return false;
+	return true;
+}
+
+// recursive fork/join: every job spawns its two halves and waits for them
+class SumJob : public Job
+{
+public:
+	int begin = 0, end = 0;
+	std::uint64_t sum = 0;
+	void Main()
+	{
+		if (end - begin <= 16)
+		{
+			for (int i = begin; i < end; ++i)
+				sum += i;
+			return;
+		}
+		SumJob low, high;
+		low.begin = begin, low.end = (begin + end) / 2;
+		high.begin = low.end, high.end = end;
+		JobGroup group;
+		JobManager::GetJobManager()->Spawn(&low, group);
+		JobManager::GetJobManager()->Spawn(&high, group);
+		JobManager::GetJobManager()->Wait(group);
+		sum = low.sum + high.sum;
+	}
+};
+
+static bool TestForkJoin()
+{
+	SumJob root;
+	root.begin = 0, root.end = 100000;
+	JobGroup group;
+	JobManager::GetJobManager()->Spawn(&root, group);
+	JobManager::GetJobManager()->Wait(group);
+	return root.sum == (std::uint64_t)100000 * 99999 / 2;
+}
+
+// Jobs spawned from outside while every worker sleeps, without the spawning thread helping: only
+// woken workers can run them, so a lost wake up shows as a time out.
+static bool TestWakeUp()
+{
+	std::atomic<int> count{ 0 };
+	std::vector<CountJob> jobs(64);
+	for (int round = 0; round < 20; ++round)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(2)); // the workers go to sleep
+		JobGroup group;
+		for (CountJob& j : jobs)
+		{
+			j.count = &count;
+			JobManager::GetJobManager()->Spawn(&j, group);
+		}
+		auto start = std::chrono::steady_clock::now();
+		while (group.pending.load(std::memory_order_acquire) > 0)
+		{
+			if (std::chrono::steady_clock::now() - start > std::chrono::seconds(5))
+				return false;
+			std::this_thread::yield();
+		}
+	}
+	return count.load() == 20 * (int)jobs.size();
+}
+
+int main()
+{
+	struct Case
+	{
+		const char* name;
+		bool (*test)();
+	};
+	static const Case cases[] = { { "runjobs", TestRunJobs }, { "nestedfor", TestNestedParallelFor }, { "forkjoin", TestForkJoin }, { "wakeup", TestWakeUp } };
+	int failed = 0;
+	for (unsigned int threads : { 1u, 2u, 3u, 8u })
+	{
+		JobManager::CreateJobManager(threads);
+		for (const Case& c : cases)
+		{
+			bool ok = c.test();
+			printf("%s, %u workers: %s\n", c.name, threads, ok ? "ok" : "FAILED");
+			failed += ok ? 0 : 1;
+		}
+	}
+	return failed;
+}
@@ -0,0 +1,145 @@
+#include "patterns.h"
+#include "cache.h"
+#include <algorithm>
+
+const char* patternNames[5] = { "sequential", "strided", "random", "pointerchase", "subdivide" };
+
+// xorshift64, the seed must not be 0
+static std::uint64_t Next(std::uint64_t& state)
+{
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+static void Add(Workload& w, std::uint64_t address, bool write)
+{
+	TraceRecord r;
+	r.address = address, r.size = 4, r.write = write ? 1 : 0;
+	w.accesses.push_back(r);
+}
+
+// like a loop updating one of four arrays it reads
+static void Sequential(Workload& w, std::uint64_t n)
+{
+	for (std::uint64_t i = 0; i < n; ++i)
+		Add(w, PATTERNBASE + i * 4 % PATTERNWORKINGSET, i % 4 == 3);
+}
+
+// walking down the columns of a 513 wide int map, every access lands on another line
+static void Strided(Workload& w, std::uint64_t n)
+{
+	std::uint64_t rows = PATTERNWORKINGSET / PATTERNSTRIDE, column = 0, row = 0;
+	for (std::uint64_t i = 0; i < n; ++i)
+	{
+		Add(w, PATTERNBASE + row * PATTERNSTRIDE + column * 4, i % 4 == 3);
+		if (++row == rows)
+			row = 0, column = (column + 1) % 513;
+	}
+}
+
+static void Random(Workload& w, std::uint64_t n, std::uint64_t state)
+{
+	for (std::uint64_t i = 0; i < n; ++i)
+		Add(w, PATTERNBASE + (Next(state) % (PATTERNWORKINGSET / 4)) * 4, i % 4 == 3);
+}
+
+// one random cycle through every line of the working set, each load depends on the one before
+static void PointerChase(Workload& w, std::uint64_t state)
+{
+	std::uint64_t lines = PATTERNWORKINGSET / LINESIZE;
+	std::vector<std::uint64_t> order(lines);
+	for (std::uint64_t i = 0; i < lines; ++i)
+		order[i] = i;
+	for (std::uint64_t i = lines - 1; i > 0; --i) // Fisher-Yates
+		std::swap(order[i], order[Next(state) % (i + 1)]);
+	w.chain.resize(lines);
+	for (std::uint64_t i = 0; i < lines; ++i)
+		w.chain[order[i]] = PATTERNBASE + order[(i + 1) % lines] * LINESIZE;
+}
+
+// the accesses of the diamond-square terrain generation: task stack reads and writes around
+// reads and writes of the 513x513 map, as in Terrain::Step, repeated until n accesses
+static void Subdivide(Workload& w, std::uint64_t n, std::uint64_t state)
+{
+	const std::uint64_t mapBase = PATTERNBASE, taskBase = PATTERNBASE + 2 * 513 * 513 * 4;
+	std::vector<int> map(513 * 513);
+	std::vector<int> task(5 * 512);
+	while (w.accesses.size() < n)
+	{
+		std::fill(map.begin(), map.end(), 0);
+		int corners[] = { 0, 512, 512 * 513, 512 * 513 + 512 };
+		for (int c : corners)
+		{
+			map[c] = (int)(Next(state) % 256);
+			Add(w, mapBase + c * 4, true);
+		}
+		int taskPtr = 0;
+		auto push = [&](int x1, int y1, int x2, int y2, int scale)
+		{
+			int values[] = { x1, y1, x2, y2, scale };
+			for (int i = 0; i < 5; ++i)
+			{
+				task[taskPtr * 5 + i] = values[i];
+				Add(w, taskBase + (taskPtr * 5 + i) * 4, true);
+			}
+			taskPtr++;
+		};
+		auto get = [&](int x, int y) { Add(w, mapBase + (x + y * 513) * 4, false); return map[x + y * 513]; };
+		auto set = [&](int x, int y, int v) { Add(w, mapBase + (x + y * 513) * 4, true); map[x + y * 513] = v; };
+		push(0, 0, 512, 512, 256);
+		while (taskPtr > 0 && w.accesses.size() < n)
+		{
+			taskPtr--;
+			for (int i : { 0, 2, 1, 3, 4 }) // x1, x2, y1, y2, scale
+				Add(w, taskBase + (taskPtr * 5 + i) * 4, false);
+			int* t = &task[taskPtr * 5];
+			int x1 = t[0], y1 = t[1], x2 = t[2], y2 = t[3], scale = t[4];
+			if (x2 - x1 == 1)
+				continue;
+			int cx = (x1 + x2) / 2, cy = (y1 + y2) / 2;
+			int ends[5][4] = { { cx, y1, x1, y1 }, { cx, y2, x1, y2 }, { x1, cy, x1, y1 }, { x2, cy, x2, y1 }, { cx, cy, x1, y1 } };
+			int others[5][2] = { { x2, y1 }, { x2, y2 }, { x1, y2 }, { x2, y2 }, { x2, y2 } };
+			for (int i = 0; i < 5; ++i)
+				if (get(ends[i][0], ends[i][1]) == 0)
+				{
+					int a = get(ends[i][2], ends[i][3]), b = get(others[i][0], others[i][1]);
+					set(ends[i][0], ends[i][1], (a + b) / 2 + (int)(Next(state) % scale) - scale / 2);
+				}
+			push(x1, y1, cx, cy, scale / 2);
+			push(cx, y1, x2, cy, scale / 2);
+			push(x1, cy, cx, y2, scale / 2);
+			push(cx, cy, x2, y2, scale / 2);
+		}
+	}
+	w.accesses.resize(n);
+}
+
+Workload Generate(PatternKind kind, std::uint64_t n, std::uint64_t seed)
+{
+	Workload w = { patternNames[kind] };
+	if (seed == 0)
+		seed = 1;
+	switch (kind)
+	{
+	case PATTERNSEQUENTIAL: Sequential(w, n); break;
+	case PATTERNSTRIDED: Strided(w, n); break;
+	case PATTERNRANDOM: Random(w, n, seed); break;
+	case PATTERNCHASE: PointerChase(w, seed); break;
+	default: Subdivide(w, n, seed); break;
+	}
+	return w;
+}
+
+std::vector<TraceRecord> Flatten(const Workload& chase, std::uint64_t n)
+{
+	std::vector<TraceRecord> loads(n);
+	std::uint64_t address = PATTERNBASE;
+	for (std::uint64_t i = 0; i < n; ++i)
+	{
+		loads[i].address = address, loads[i].size = 8, loads[i].write = 0;
+		address = chase.chain[(address - PATTERNBASE) / LINESIZE];
+	}
+	return loads;
+}
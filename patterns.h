@@ -0,0 +1,34 @@
+#pragma once
+#include <vector>
+#include "trace.h"
+
+// Synthetic access patterns for cachebench and the regression corpus. They are generated up front
+// from a seed, so the same seed gives the same accesses in every build and on every platform.
+
+#define PATTERNBASE 0x10000000 // where the patterns put their data, any address works in SimMemory
+#define PATTERNWORKINGSET (16 * 1024 * 1024) // bytes touched by the sequential, strided, random and chase patterns
+#define PATTERNSTRIDE (513 * 4) // one row of the terrain map
+
+enum PatternKind
+{
+	PATTERNSEQUENTIAL,
+	PATTERNSTRIDED,
+	PATTERNRANDOM,
+	PATTERNCHASE,
+	PATTERNSUBDIVIDE
+};
+
+struct Workload
+{
+	const char* name;
+	std::vector<TraceRecord> accesses; // 4 byte reads and writes, every fourth one a write unless noted
+	std::vector<std::uint64_t> chain; // pointer chase only: address of the next line for every line
+};
+
+extern const char* patternNames[5]; // indexed by PatternKind
+
+// n accesses of a pattern, the pointer chase builds its chain instead (see Flatten)
+Workload Generate(PatternKind kind, std::uint64_t n, std::uint64_t seed);
+
+// the first n loads of a pointer chase, starting at PATTERNBASE
+std::vector<TraceRecord> Flatten(const Workload& chase, std::uint64_t n);
@@ -0,0 +1,129 @@
+#ifdef __linux__
+#include "counters.h"
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <cstdint>
+
+// The counters.h API on Linux, through perf_event_open instead of the MSR driver counters.cpp uses on
+// Windows. Every event is opened on its own, so an event the CPU or kernel does not support only drops
+// that counter. Without any (no PMU in a VM, perf_event_paranoid too strict) GetNrCounters returns 0.
+
+#define PERFCOUNTERS 5
+
+#define PERFCACHE(cache, result) (PERF_COUNT_HW_CACHE_##cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_##result << 16))
+
+struct PerfCounter
+{
+	char name[16];
+	std::uint32_t type;
+	std::uint64_t config;
+	bool intelOnly; // raw event, only meaningful on Intel
+};
+
+// generic events where the kernel has one, all of them loads only. L2 has none: L2_RQSTS.DEMAND_DATA_RD_MISS
+// (event 0x24, umask 0x21) on Intel
+static const PerfCounter perfCounters[PERFCOUNTERS] =
+{
+	{ "Core cyc", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, false },
+	{ "L1D Miss", PERF_TYPE_HW_CACHE, PERFCACHE(L1D, MISS), false },
+	{ "L2 Miss", PERF_TYPE_RAW, 0x2124, true },
+	{ "LLC Miss", PERF_TYPE_HW_CACHE, PERFCACHE(LL, MISS), false },
+	{ "dTLBMiss", PERF_TYPE_HW_CACHE, PERFCACHE(DTLB, MISS), false }
+};
+
+static int fds[PERFCOUNTERS]; // of the counters that opened, in the order of perfCounters
+static int counterIndex[PERFCOUNTERS]; // perfCounters entry of every open counter
+static long long results[PERFCOUNTERS];
+static int NumCounters = 0;
+
+static bool IsIntel()
+{
+	FILE* f = fopen("/proc/cpuinfo", "r");
+	if (f == nullptr)
+		return false;
+	char line[256];
+	bool intel = false;
+	while (!intel && fgets(line, sizeof(line), f) != nullptr)
+		intel = strncmp(line, "vendor_id", 9) == 0 && strstr(line, "GenuineIntel") != nullptr;
+	fclose(f);
+	return intel;
+}
+
+static int Open(const PerfCounter& counter)
+{
+	perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = counter.type;
+	attr.config = counter.config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0); // this thread, any cpu
+}
+
+void InitPerformanceCounters()
+{
+	if (NumCounters > 0)
+		return;
+	bool intel = IsIntel();
+	int error = 0;
+	for (int i = 0; i < PERFCOUNTERS; ++i)
+	{
+		if (perfCounters[i].intelOnly && !intel)
+			continue;
+		int fd = Open(perfCounters[i]);
+		if (fd < 0)
+		{
+			error = errno;
+			continue;
+		}
+		counterIndex[NumCounters] = i;
+		fds[NumCounters++] = fd;
+	}
+	if (NumCounters == 0)
+	{
+		printf("No hardware counters available (%s)", error != 0 ? strerror(error) : "not an Intel CPU");
+		if (error == EACCES || error == EPERM) // other errors (ENOENT, ENODEV, ...) mean no PMU, not missing permission
+			printf(", see /proc/sys/kernel/perf_event_paranoid");
+		printf("\n");
+	}
+	else if (NumCounters < PERFCOUNTERS)
+		printf("%d of %d hardware counters available\n", NumCounters, PERFCOUNTERS);
+}
+
+void StartMeasurement()
+{
+	for (int i = 0; i < NumCounters; ++i)
+		ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+	for (int i = 0; i < NumCounters; ++i)
+		ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+}
+
+void StopMeasurement()
+{
+	for (int i = 0; i < NumCounters; ++i)
+		ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+	for (int i = 0; i < NumCounters; ++i)
+	{
+		std::uint64_t value[3] = {}; // count, time enabled, time running
+		if (read(fds[i], value, sizeof(value)) != sizeof(value))
+			value[0] = 0;
+		double count = (double)value[0];
+		if (value[2] > 0 && value[2] < value[1]) // multiplexed with other events, scale up to the whole time
+			count *= (double)value[1] / value[2];
+		results[i] = (long long)count;
+	}
+}
+
+int GetNrCounters() { return NumCounters; }
+char* GetCounterName( int idx ) { return (char*)perfCounters[counterIndex[idx]].name; }
+long long GetCounterValue( int idx ) { return results[idx]; }
+
+#endif
@@ -0,0 +1,167 @@
+#include "pipeline.h"
+#include "dram.h"
+#include "sim.h"
+#include "tagcache.h"
+#include "trace.h"
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+PipeLink::PipeLink()
+{
+	for (int i = 0; i < PIPEBATCHES; ++i)
+	{
+		batches.emplace_back(new PipeBatch());
+		batches.back()->reserve(PIPEBATCH + 1); // an access adds at most a fill and a write back, then the batch is sent
+		empty.Push(batches.back().get());
+	}
+}
+
+PipeBatch* PipeLink::Take()
+{
+	PipeBatch* const* b;
+	while ((b = empty.Front()) == nullptr) // the next level holds every batch, let it catch up
+		std::this_thread::yield();
+	PipeBatch* batch = *b;
+	empty.Pop();
+	batch->clear();
+	return batch;
+}
+
+void PipeLink::Send(PipeBatch* b)
+{
+	full.Push(b); // never full, there are no more batches than slots
+}
+
+void PipeLink::Close()
+{
+	closed.store(true, std::memory_order_release);
+}
+
+PipeBatch* PipeLink::Receive()
+{
+	while (true)
+	{
+		bool done = closed.load(std::memory_order_acquire); // first, so whatever was sent before closing is seen below
+		PipeBatch* const* b = full.Front();
+		if (b != nullptr)
+		{
+			PipeBatch* batch = *b;
+			full.Pop();
+			return batch;
+		}
+		if (done)
+			return nullptr;
+		std::this_thread::yield();
+	}
+}
+
+void PipeLink::Release(PipeBatch* b)
+{
+	empty.Push(b);
+}
+
+// One level and the memory level it sends to, which records the fills and write backs into the batch
+// for the next stage. The last stage is memory, see RunMemory, which only uses in.
+struct PipeStage
+{
+	TagLevel below, level;
+	PipeLink in;
+
+	PipeStage(int sets, int ways) : level(sets, ways, &below) { }
+};
+
+// the thread of a cache level
+static void RunStage(PipeStage& stage, PipeLink& out)
+{
+	PipeBatch* batch = out.Take();
+	stage.below.record = batch;
+	PipeBatch* b;
+	while ((b = stage.in.Receive()) != nullptr)
+	{
+		for (std::uint64_t a : *b)
+		{
+			stage.level.Access(a >> 1, (a & 1) != 0);
+			if (batch->size() >= PIPEBATCH)
+			{
+				out.Send(batch);
+				stage.below.record = batch = out.Take();
+			}
+		}
+		stage.in.Release(b);
+	}
+	if (!batch->empty())
+		out.Send(batch);
+	out.Close();
+}
+
+// the thread of memory: the DRAM model queues, schedules and times every fill and write back
+static void RunMemory(PipeLink& in, DRAM& dram)
+{
+	PipeBatch* b;
+	while ((b = in.Receive()) != nullptr)
+	{
+		for (std::uint64_t a : *b)
+			dram.AccessTag((a >> 1) * LINESIZE, (a & 1) != 0);
+		in.Release(b);
+	}
+	dram.Drain();
+}
+
+bool RunPipeline(const char* trace, int first)
+{
+	TraceReader in(trace);
+	if (!in.IsOpen())
+	{
+		std::cerr << "Could not read " << trace << std::endl;
+		return false;
+	}
+
+	// the simulated geometry, the regression corpus checks that tag-only levels agree with it
+	std::unique_ptr<PipeStage> stages[] = { std::unique_ptr<PipeStage>(new PipeStage(l1.sets, l1.ways)),
+		std::unique_ptr<PipeStage>(new PipeStage(l2.sets, l2.ways)), std::unique_ptr<PipeStage>(new PipeStage(l3.sets, l3.ways)),
+		std::unique_ptr<PipeStage>(new PipeStage(0, 0)) };
+	DRAM dram; // the simulated memory timing, its own instance so the simulator's stays untouched
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	for (int s = first - 1; s < 3; ++s)
+		threads.emplace_back(RunStage, std::ref(*stages[s]), std::ref(stages[s + 1]->in));
+	threads.emplace_back(RunMemory, std::ref(stages[3]->in), std::ref(dram));
+
+	// this thread decodes the trace into batches for the first stage
+	static TraceRecord records[TRACEBUFFER];
+	PipeLink& link = stages[first - 1]->in;
+	PipeBatch* batch = link.Take();
+	int n;
+	while ((n = in.Read(records, TRACEBUFFER)) > 0)
+		for (int i = 0; i < n; ++i)
+		{
+			batch->push_back(records[i].address / LINESIZE << 1 | (records[i].write & 1));
+			if (batch->size() == PIPEBATCH)
+			{
+				link.Send(batch);
+				batch = link.Take();
+			}
+		}
+	if (!batch->empty())
+		link.Send(batch);
+	link.Close();
+	for (std::thread& t : threads)
+		t.join();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	static const char* names[] = { "L1", "L2", "L3" };
+	std::cout << "level,reads,writes,readmisses,writemisses,cleanevicts,dirtyevicts,rowhits,rowmisses,rowconflicts,cycles" << std::endl;
+	for (int s = first - 1; s < 3; ++s)
+	{
+		const TagLevel& level = stages[s]->level;
+		std::cout << names[s] << "," << level.reads << "," << level.writes << "," << level.readmisses << "," << level.writemisses << ","
+			<< level.cleanevicts << "," << level.dirtyevicts << ",,,," << std::endl;
+	}
+	std::cout << "memory," << dram.reads << "," << dram.writes << ",,,,," << dram.rowhits << "," << dram.rowmisses << "," << dram.rowconflicts << ","
+		<< dram.Cycles() << std::endl;
+	std::uint64_t accesses = stages[first - 1]->level.reads + stages[first - 1]->level.writes;
+	std::cerr << accesses << " accesses through L" << first << " to memory on " << threads.size() + 1 << " threads in " << elapsed.count() << "s ("
+		<< accesses / elapsed.count() / 1e6 << "M accesses/s)" << std::endl;
+	return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "spscring.h"
+
+// Pipelined tag-only hierarchy: L1, L2, L3 and memory each run on a thread of their own, so one serial
+// trace keeps four cores busy. Levels only talk through their fills and write backs (tagcache.h), and
+// no data flows back up, so a level never waits for an answer: it records what it sends down into a
+// batch and hands full batches to the next level through a lock-free link. Every level sees the same
+// accesses in the same order as in the chained hierarchy, which keeps the counters exactly the same.
+// The memory stage runs the DRAM model of dram.h on what reaches it, for row buffer stats and timing.
+// Tag-only levels take no time there, so requests arrive spaced by the nominal DRAM latency alone.
+
+#define PIPEBATCH 4096 // line accesses per batch, a level sends as soon as it has this many
+#define PIPEBATCHES 64 // batches per link, a power of 2
+
+typedef std::vector<std::uint64_t> PipeBatch; // line numbers shifted left by one with the write bit below them
+
+typedef SpscRing<PipeBatch*, PIPEBATCHES> BatchRing;
+
+// Link from one level to the next: full batches go down, emptied ones come back up to be filled again.
+// A link owns PIPEBATCHES batches, so neither ring is ever full and a level only waits when the next
+// one holds every batch.
+class PipeLink
+{
+public:
+	PipeLink();
+
+	PipeBatch* Take(); // producer: an empty batch
+	void Send(PipeBatch* b); // producer
+	void Close(); // producer: nothing follows the batches sent so far
+	PipeBatch* Receive(); // consumer: the next full batch, nullptr once the link is closed and drained
+	void Release(PipeBatch* b); // consumer: done with a batch from Receive
+
+private:
+	BatchRing full, empty;
+	std::atomic<bool> closed{ false };
+	std::vector<std::unique_ptr<PipeBatch>> batches;
+};
+
+// run trace, as seen by level first (1 to 3), through the simulated geometry with a thread per level
+// and print the counters of every level and the row buffer outcomes and cycles of memory
+bool RunPipeline(const char* trace, int first = 1);
@@ -4,6 +4,7 @@
 #define GLM_FORCE_RADIANS
 // #define OLDTEMPLATESTYLE
 // #define ENABLECACHETEST
+#include "simconfig.h"
 
 #include <inttypes.h>
 extern "C" 
@@ -29,6 +30,7 @@ using namespace Tmpl8;				// to use template classes
 using namespace glm;				// to use glm vector stuff
 
 #include <vector>
+#include <atomic>
 #include "game.h"
 #include "fcntl.h"
 #include "threads.h"
@@ -0,0 +1,93 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Reference model of the hierarchy in cache.h, written to be obviously right rather than fast: no data,
+// no templates, every set a vector of ways and tree PLRU kept as one bit per node in heap order.
+// It follows the same rules as Cache: misses fetch the line from the next level before evicting,
+// invalid ways are filled first, dirty victims are written to the next level, writes allocate.
+// A level without sets stands for memory and only counts reads and writes.
+class ReferenceLevel
+{
+public:
+	std::uint64_t reads = 0, writes = 0, readmisses = 0, writemisses = 0, cleanevicts = 0, dirtyevicts = 0;
+
+	ReferenceLevel(int nrOfSets = 0, int nrOfWays = 0, ReferenceLevel* next = nullptr)
+		: sets(nrOfSets), ways(nrOfWays), nextLevel(next), lines(nrOfSets * nrOfWays), plru(nrOfSets * nrOfWays) { }
+
+	// access to the line with number line (address / LINESIZE)
+	void Access(std::uint64_t line, bool write)
+	{
+		(write ? writes : reads)++;
+		if (sets == 0)
+			return;
+
+		int set = (int)(line % sets), way = Find(set, line);
+		if (way < 0)
+		{
+			(write ? writemisses : readmisses)++;
+			nextLevel->Access(line, false);
+			way = Victim(set);
+			Line& victim = lines[set * ways + way];
+			if (victim.valid)
+			{
+				(victim.dirty ? dirtyevicts : cleanevicts)++;
+				if (victim.dirty)
+					nextLevel->Access(victim.line, true);
+			}
+			victim.line = line, victim.valid = true, victim.dirty = false;
+		}
+		Touch(set, way);
+		if (write)
+			lines[set * ways + way].dirty = true;
+	}
+
+private:
+	struct Line
+	{
+		std::uint64_t line = 0;
+		bool valid = false, dirty = false;
+	};
+
+	int sets, ways;
+	ReferenceLevel* nextLevel;
+	std::vector<Line> lines; // way w of set s at s * ways + w
+	std::vector<bool> plru; // node n of set s at s * ways + n, the root is node 1, children of n are 2n and 2n + 1
+
+	int Find(int set, std::uint64_t line) const
+	{
+		for (int w = 0; w < ways; ++w)
+			if (lines[set * ways + w].valid && lines[set * ways + w].line == line)
+				return w;
+		return -1;
+	}
+
+	// the first invalid way, or the one the tree points at: a set bit means the right half is older
+	int Victim(int set) const
+	{
+		for (int w = 0; w < ways; ++w)
+			if (!lines[set * ways + w].valid)
+				return w;
+		int node = 1, first = 0;
+		for (int span = ways / 2; span > 0; span /= 2)
+		{
+			bool right = plru[set * ways + node];
+			node = 2 * node + right;
+			first += right ? span : 0;
+		}
+		return first;
+	}
+
+	// point every node on the path to way away from it
+	void Touch(int set, int way)
+	{
+		int node = 1, first = 0;
+		for (int span = ways / 2; span > 0; span /= 2)
+		{
+			bool right = way >= first + span;
+			plru[set * ways + node] = !right;
+			node = 2 * node + right;
+			first += right ? span : 0;
+		}
+	}
+};
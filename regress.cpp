@@ -0,0 +1,202 @@
+#include "regress.h"
+#include "patterns.h"
+#include "reference.h"
+#include "tagcache.h"
+#include "sim.h"
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+#define REGRESSCOUNTERS 6 // counters compared per level, see Counters
+#define REGRESSCHECK 4096 // accesses between comparisons of the counters, see Lockstep
+
+struct RegressCase
+{
+	const char* name;
+	PatternKind kind;
+	std::uint64_t accesses, seed;
+};
+
+// the corpus, changing a case means regenerating the golden file
+static const RegressCase corpus[] =
+{
+	{ "sequential", PATTERNSEQUENTIAL, 200000, 1 },
+	{ "strided", PATTERNSTRIDED, 200000, 1 },
+	{ "random1", PATTERNRANDOM, 200000, 1 },
+	{ "random2", PATTERNRANDOM, 200000, 2 },
+	{ "pointerchase", PATTERNCHASE, 100000, 3 },
+	{ "subdivide1", PATTERNSUBDIVIDE, 600000, 1 },
+	{ "subdivide2", PATTERNSUBDIVIDE, 600000, 7 }
+};
+
+static const char* levelNames[] = { "l1", "l2", "l3", "ram" };
+static const char* counterNames[] = { "reads", "writes", "readmisses", "writemisses", "cleanevicts", "dirtyevicts" };
+
+template<typename Level>
+static void Counters(const Level& level, std::uint64_t* c)
+{
+	c[0] = level.reads, c[1] = level.writes, c[2] = level.readmisses;
+	c[3] = level.writemisses, c[4] = level.cleanevicts, c[5] = level.dirtyevicts;
+}
+
+void ResetHierarchy()
+{
+	l1.Flush();
+	SimMemory::GetMemory()->Clear();
+	SimResetStats();
+}
+
+// runs the accesses through the simulator, the reference and the tag-only levels of sweeps side by side,
+// false after reporting the first access where they disagree. The simulator sums its counters from its
+// sets, so they are compared every accesses only, and once they disagree the case is run again
+// comparing after every access to find the first one.
+static bool Lockstep(const RegressCase& c, const std::vector<TraceRecord>& accesses, std::size_t every = REGRESSCHECK)
+{
+	ReferenceLevel memory, r3(l3.sets, l3.ways, &memory), r2(l2.sets, l2.ways, &r3), r1(l1.sets, l1.ways, &r2);
+	CacheBase* simulated[] = { &l1, &l2, &l3, &ram };
+	ReferenceLevel* reference[] = { &r1, &r2, &r3, &memory };
+	TagLevel tagMemory, t3(l3.sets, l3.ways, &tagMemory), t2(l2.sets, l2.ways, &t3), t1(l1.sets, l1.ways, &t2);
+	TagLevel* tagged[] = { &t1, &t2, &t3, &tagMemory };
+	std::unordered_map<std::uint64_t, std::uint64_t> written; // last value written to every address
+	for (std::size_t i = 0; i < accesses.size(); ++i)
+	{
+		const TraceRecord& a = accesses[i];
+		std::uint64_t value = 0, expected = 0;
+		if (a.write)
+		{
+			value = a.size == 4 ? (std::uint32_t)(i * 2654435761u) : i * 0x9e3779b97f4a7c15ull;
+			if (a.size == 4) l1.WriteData<std::uint32_t>(a.address, (std::uint32_t)value);
+			else l1.WriteData<std::uint64_t>(a.address, value);
+			written[a.address] = value;
+		}
+		else
+		{
+			value = a.size == 4 ? l1.ReadData<std::uint32_t>(a.address) : l1.ReadData<std::uint64_t>(a.address);
+			auto w = written.find(a.address);
+			expected = w != written.end() ? w->second : 0;
+		}
+		r1.Access(a.address / LINESIZE, a.write != 0);
+		t1.Access(a.address / LINESIZE, a.write != 0);
+
+		const char* kind = a.write ? "write" : "read";
+		if (!a.write && value != expected)
+		{
+			printf("%s: access %llu (%s of 0x%llx) read %llu, last written %llu\n", c.name, (unsigned long long)i, kind,
+				(unsigned long long)a.address, (unsigned long long)value, (unsigned long long)expected);
+			return false;
+		}
+		if ((i + 1) % every != 0 && i + 1 != accesses.size())
+			continue;
+		for (int l = 0; l < 4; ++l)
+		{
+			std::uint64_t s[REGRESSCOUNTERS], r[REGRESSCOUNTERS], t[REGRESSCOUNTERS];
+			simulated[l]->Tally();
+			Counters(*simulated[l], s);
+			Counters(*reference[l], r);
+			Counters(*tagged[l], t);
+			for (int k = 0; k < REGRESSCOUNTERS; ++k)
+				if (s[k] != r[k] || t[k] != r[k])
+				{
+					if (every > 1)
+					{
+						ResetHierarchy();
+						return Lockstep(c, accesses, 1);
+					}
+					printf("%s: first divergence at access %llu (%s of 0x%llx): %s %s is %llu, reference %llu, tag-only %llu\n", c.name, (unsigned long long)i,
+						kind, (unsigned long long)a.address, levelNames[l], counterNames[k], (unsigned long long)s[k], (unsigned long long)r[k], (unsigned long long)t[k]);
+					return false;
+				}
+		}
+	}
+	return true;
+}
+
+// "case level" to counters, empty if the file cannot be read
+static std::map<std::string, std::vector<std::uint64_t>> ReadGolden(const char* file)
+{
+	std::map<std::string, std::vector<std::uint64_t>> golden;
+	FILE* f = fopen(file, "r");
+	if (f == nullptr)
+		return golden;
+
+	char line[512], name[128], level[16];
+	while (fgets(line, sizeof(line), f) != nullptr)
+	{
+		unsigned long long c[REGRESSCOUNTERS];
+		if (line[0] == '#' || sscanf(line, "%127s %15s %llu %llu %llu %llu %llu %llu", name, level, &c[0], &c[1], &c[2], &c[3], &c[4], &c[5]) != 8)
+			continue;
+		golden[std::string(name) + " " + level] = std::vector<std::uint64_t>(c, c + REGRESSCOUNTERS);
+	}
+	fclose(f);
+	return golden;
+}
+
+int RunRegression(const char* golden, bool update)
+{
+	std::map<std::string, std::vector<std::uint64_t>> expected;
+	if (!update)
+	{
+		expected = ReadGolden(golden);
+		if (expected.empty())
+		{
+			printf("Could not read %s\n", golden);
+			return 1;
+		}
+	}
+
+	std::string results = "# case level reads writes readmisses writemisses cleanevicts dirtyevicts\n";
+	CacheBase* simulated[] = { &l1, &l2, &l3, &ram };
+	int failed = 0;
+	for (const RegressCase& c : corpus)
+	{
+		ResetHierarchy();
+		Workload w = Generate(c.kind, c.accesses, c.seed);
+		bool ok = Lockstep(c, c.kind == PATTERNCHASE ? Flatten(w, c.accesses) : w.accesses);
+		for (int l = 0; ok && l < 4; ++l)
+		{
+			std::uint64_t s[REGRESSCOUNTERS];
+			simulated[l]->Tally();
+			Counters(*simulated[l], s);
+			std::string key = std::string(c.name) + " " + levelNames[l];
+			char line[256];
+			sprintf(line, "%s %llu %llu %llu %llu %llu %llu\n", key.c_str(), (unsigned long long)s[0], (unsigned long long)s[1],
+				(unsigned long long)s[2], (unsigned long long)s[3], (unsigned long long)s[4], (unsigned long long)s[5]);
+			results += line;
+			if (update)
+				continue;
+
+			auto g = expected.find(key);
+			if (g == expected.end())
+			{
+				printf("%s: no golden counters for %s\n", c.name, levelNames[l]);
+				ok = false;
+				continue;
+			}
+			for (int k = 0; k < REGRESSCOUNTERS; ++k)
+				if (s[k] != g->second[k])
+				{
+					printf("%s: %s %s is %llu, golden %llu\n", c.name, levelNames[l], counterNames[k], (unsigned long long)s[k], (unsigned long long)g->second[k]);
+					ok = false;
+				}
+		}
+		printf("%s: %s\n", c.name, ok ? "ok" : "FAILED");
+		failed += ok ? 0 : 1;
+	}
+	ResetHierarchy();
+
+	if (update)
+	{
+		FILE* f = failed == 0 ? fopen(golden, "w") : nullptr;
+		if (f == nullptr)
+		{
+			printf("%s not written\n", golden);
+			return failed > 0 ? failed : 1;
+		}
+		fputs(results.c_str(), f);
+		fclose(f);
+		printf("Golden counters written to %s\n", golden);
+	}
+	return failed;
+}
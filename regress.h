@@ -0,0 +1,12 @@
+#pragma once
+
+// Regression corpus: seeded synthetic workloads run through the simulated hierarchy (l1 in sim.cpp)
+// from empty caches. Every access is checked against the reference model in reference.h and the
+// tag-only levels in tagcache.h, stopping a case at the first access where a counter or a value read
+// differs, and the final counters of every level are compared with the golden file. With update set
+// the golden file is written instead, which only happens when every case agrees with the reference.
+// Returns the number of failed cases.
+int RunRegression(const char* golden, bool update);
+
+// empty caches, memory and counters, as at startup
+void ResetHierarchy();
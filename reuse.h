@@ -0,0 +1,235 @@
+#pragma once
+#include <stdint.h>
+#include <cstdint>
+#include <stdio.h>
+#include <algorithm>
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include "cache.h"
+
+#define SHARDSMODULUS (1 << 24) // hash space for spatial sampling
+#define REUSESUBBUCKETS 8 // histogram buckets per power of two distance
+
+// Measures reuse distances (distinct lines touched between two accesses to the same line) and
+// turns them into the miss ratio curve of fully associative LRU caches of every size.
+// Distances are counted with a Fenwick tree over last access times, so each access is O(log n).
+// With a sampling rate below 1 only lines whose hash falls under a threshold are tracked (SHARDS).
+// maxLines bounds the number of tracked lines by lowering that threshold as needed, at rate 1 too,
+// where the profile turns from exact into sampled once more lines than that have been touched.
+class ReuseProfiler
+{
+public:
+	std::uint64_t accesses = 0, sampled = 0;
+
+	ReuseProfiler(double rate = 1.0, int maxLines = 0)
+		: threshold((std::uint32_t)(rate * SHARDSMODULUS)), maxLines(maxLines)
+	{
+		tree.resize(1024 + 1, 0);
+	}
+
+	void Access(std::uintptr_t address)
+	{
+		accesses++;
+		std::uintptr_t line = address / LINESIZE;
+		std::uint32_t hash = 0;
+		bool hashed = threshold < SHARDSMODULUS || maxLines > 0; // lines are kept by hash to lower the threshold
+		if (hashed)
+		{
+			hash = Hash(line) & (SHARDSMODULUS - 1);
+			if (hash >= threshold)
+				return;
+		}
+
+		sampled++;
+		double scale = (double)SHARDSMODULUS / threshold; // each sampled reference stands for this many
+		if (now + 1 == (std::uint64_t)tree.size())
+			Compact();
+		now++;
+
+		std::unordered_map<std::uintptr_t, std::uint64_t>::iterator it = last.find(line);
+		if (it == last.end())
+		{
+			cold += scale;
+			last[line] = now;
+			if (hashed)
+			{
+				byHash.insert(std::make_pair(hash, line));
+				if (maxLines > 0 && (int)last.size() > maxLines)
+					Shrink();
+			}
+		}
+		else
+		{
+			std::uint64_t distance = Sum(now - 1) - Sum(it->second);
+			Count((std::uint64_t)(distance * scale), scale);
+			Add(it->second, -1);
+			it->second = now;
+		}
+		Add(now, 1);
+	}
+
+	// forget the histogram but keep tracking the lines already seen
+	void ResetStats()
+	{
+		accesses = sampled = 0;
+		cold = 0;
+		histogram.clear();
+	}
+
+	// write distance, distance in bytes and (estimated) references per histogram bucket
+	bool WriteHistogram(const char* file) const
+	{
+		FILE* f = fopen(file, "w");
+		if (f == nullptr)
+			return false;
+
+		fprintf(f, "distance_lines,distance_bytes,references\n");
+		std::vector<double> h = Adjusted();
+		for (std::size_t i = 0; i < h.size(); ++i)
+			if (h[i] > 0)
+				fprintf(f, "%llu,%llu,%.0f\n", (unsigned long long)BucketStart(i), (unsigned long long)BucketStart(i) * LINESIZE, h[i]);
+		fprintf(f, "cold,cold,%.0f\n", cold);
+		fclose(f);
+		return true;
+	}
+
+	// write the miss ratio of a fully associative LRU cache for every bucket boundary as size
+	bool WriteMissRatioCurve(const char* file) const
+	{
+		FILE* f = fopen(file, "w");
+		if (f == nullptr)
+			return false;
+
+		fprintf(f, "cache_lines,cache_bytes,miss_ratio\n");
+		std::vector<double> h = Adjusted();
+		double total = cold;
+		for (double count : h)
+			total += count;
+
+		// a cache of size lines hits every reference with a distance below size
+		double misses = total;
+		for (std::size_t i = 0; i < h.size(); ++i)
+		{
+			fprintf(f, "%llu,%llu,%f\n", (unsigned long long)BucketStart(i), (unsigned long long)BucketStart(i) * LINESIZE, total > 0 ? misses / total : 0.0);
+			misses -= h[i];
+		}
+		fprintf(f, "%llu,%llu,%f\n", (unsigned long long)BucketStart(h.size()), (unsigned long long)BucketStart(h.size()) * LINESIZE, total > 0 ? cold / total : 0.0);
+		fclose(f);
+		return true;
+	}
+
+private:
+	std::uint32_t threshold;
+	int maxLines;
+	std::uint64_t now = 0; // time of the latest sampled access
+	double cold = 0; // first references, estimated
+	std::vector<double> histogram; // estimated references per bucket
+	std::unordered_map<std::uintptr_t, std::uint64_t> last; // last access time of every tracked line
+	std::vector<int> tree; // Fenwick tree holding a 1 at the last access time of every tracked line
+	std::set<std::pair<std::uint32_t, std::uintptr_t> > byHash; // tracked lines by hash, when sampling or bounded
+
+	// first distance in bucket i, distances below REUSESUBBUCKETS * 2 get a bucket each
+	static std::uint64_t BucketStart(std::size_t i)
+	{
+		if (i < 2 * REUSESUBBUCKETS)
+			return i;
+		std::size_t e = i / REUSESUBBUCKETS, sub = i % REUSESUBBUCKETS; // e is 1 more than the exponent
+		return (std::uint64_t)(REUSESUBBUCKETS + sub) << (e - 1);
+	}
+
+	static std::size_t Bucket(std::uint64_t distance)
+	{
+		if (distance < 2 * REUSESUBBUCKETS)
+			return (std::size_t)distance;
+		int e = 0;
+		while ((distance >> e) >= 2 * REUSESUBBUCKETS)
+			e++;
+		return (e + 1) * REUSESUBBUCKETS + (std::size_t)((distance >> e) - REUSESUBBUCKETS);
+	}
+
+	void Count(std::uint64_t distance, double weight)
+	{
+		std::size_t b = Bucket(distance);
+		if (b >= histogram.size())
+			histogram.resize(b + 1, 0);
+		histogram[b] += weight;
+	}
+
+	// SHARDS-adj: references lost to sampling noise are credited to the smallest distance
+	std::vector<double> Adjusted() const
+	{
+		std::vector<double> h = histogram;
+		if (threshold < SHARDSMODULUS)
+		{
+			double estimated = cold;
+			for (double count : h)
+				estimated += count;
+			if (h.empty())
+				h.resize(1, 0);
+			h[0] += accesses - estimated;
+			if (h[0] < 0)
+				h[0] = 0;
+		}
+		return h;
+	}
+
+	// stop tracking the lines with the largest hash until under the limit, lowering the threshold
+	void Shrink()
+	{
+		while ((int)last.size() > maxLines)
+		{
+			threshold = byHash.rbegin()->first;
+			while (!byHash.empty() && byHash.rbegin()->first >= threshold)
+			{
+				std::uintptr_t line = byHash.rbegin()->second;
+				byHash.erase(--byHash.end());
+				Add(last[line], -1);
+				last.erase(line);
+			}
+		}
+	}
+
+	// renumber the last access times 1..n so the tree never grows beyond twice the tracked lines
+	void Compact()
+	{
+		std::vector<std::pair<std::uint64_t, std::uintptr_t> > order;
+		order.reserve(last.size());
+		for (const std::pair<const std::uintptr_t, std::uint64_t>& entry : last)
+			order.push_back(std::make_pair(entry.second, entry.first));
+		std::sort(order.begin(), order.end());
+
+		std::size_t size = 2 * order.size() + 1024;
+		tree.assign(size + 1, 0);
+		for (std::size_t i = 0; i < order.size(); ++i)
+		{
+			last[order[i].second] = i + 1;
+			Add(i + 1, 1);
+		}
+		now = order.size();
+	}
+
+	void Add(std::uint64_t i, int value)
+	{
+		for (; i < tree.size(); i += i & (~i + 1))
+			tree[i] += value;
+	}
+
+	std::uint64_t Sum(std::uint64_t i) const
+	{
+		std::uint64_t sum = 0;
+		for (; i > 0; i -= i & (~i + 1))
+			sum += tree[i];
+		return sum;
+	}
+
+	static std::uint64_t Hash(std::uint64_t x)
+	{
+		x ^= x >> 33;
+		x *= 0xff51afd7ed558ccdULL;
+		x ^= x >> 33;
+		x *= 0xc4ceb9fe1a85ec53ULL;
+		x ^= x >> 33;
+		return x;
+	}
+};
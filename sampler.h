@@ -0,0 +1,102 @@
+#pragma once
+#include <math.h>
+#include <vector>
+#include "cache.h"
+#include "trace.h"
+
+// lengths of the three phases of every sampling period, in accesses
+struct SamplingConfig
+{
+	std::uint64_t fastForward = 1000000; // tag-only warming, see CacheBase::WarmTag
+	std::uint64_t warmup = 20000; // detailed simulation, stats discarded
+	std::uint64_t measure = 10000; // detailed simulation, stats kept
+};
+
+// SMARTS style systematic sampling of a trace. Between measurement windows only the tags and replacement
+// state of the hierarchy are warmed, so caches stay warm at a fraction of the cost of detailed simulation.
+// Every window gives one miss rate per level, their spread gives the confidence interval.
+class SmartsSampler
+{
+public:
+	std::uint64_t accesses = 0; // accesses in the trace
+
+	SmartsSampler(CacheBase** levels, int nrOfLevels, const SamplingConfig& c = SamplingConfig())
+		: levels(levels, levels + nrOfLevels), config(c), windows(nrOfLevels)
+	{
+		memset(zeros, 0, sizeof(zeros));
+	}
+
+	// replay the whole trace, returns false if it could not be read
+	bool Run(const char* file)
+	{
+		TraceReader trace(file);
+		if (!trace.IsOpen())
+			return false;
+
+		std::uint64_t period = config.fastForward + config.warmup + config.measure;
+		std::vector<std::uint64_t> start(levels.size());
+		TraceRecord* records = new TraceRecord[TRACEBUFFER];
+		for (int count; (count = trace.Read(records, TRACEBUFFER)) > 0;)
+			for (int i = 0; i < count; ++i, ++accesses)
+			{
+				std::uint64_t phase = accesses % period;
+				const TraceRecord& r = records[i];
+				if (phase < config.fastForward)
+				{
+					levels[0]->WarmTag(r.address, r.write != 0);
+					continue;
+				}
+
+				if (phase == config.fastForward + config.warmup) // measurement window opens
+					for (std::size_t l = 0; l < levels.size(); ++l)
+						start[l] = Misses(levels[l]);
+
+				if (r.write) levels[0]->WriteData(r.address, r.size, zeros);
+				else levels[0]->ReadData(r.address);
+
+				if (phase == period - 1) // measurement window closes
+					for (std::size_t l = 0; l < levels.size(); ++l)
+						windows[l].push_back((double)(Misses(levels[l]) - start[l]) / config.measure);
+			}
+
+		delete[] records;
+		return true;
+	}
+
+	// misses per trace access at every level, estimated over all windows with a 95% confidence interval
+	void PrintStats()
+	{
+		std::cout << "Accesses: " << accesses << std::endl;
+		std::cout << "Measurement windows: " << windows[0].size() << " of " << config.measure << " accesses" << std::endl;
+		for (std::size_t l = 0; l < levels.size(); ++l)
+		{
+			std::vector<double>& w = windows[l];
+			if (w.empty())
+				continue;
+
+			double mean = 0, variance = 0;
+			for (double rate : w)
+				mean += rate;
+			mean /= w.size();
+			for (double rate : w)
+				variance += (rate - mean) * (rate - mean);
+			variance = w.size() > 1 ? variance / (w.size() - 1) : 0;
+			double interval = 1.96 * sqrt(variance / w.size());
+
+			std::cout << "L" << l + 1 << " misses per access: " << mean << " +/- " << interval;
+			std::cout << " (estimated " << (std::uint64_t)(mean * accesses) << " misses)" << std::endl;
+		}
+	}
+
+private:
+	std::vector<CacheBase*> levels;
+	SamplingConfig config;
+	std::vector<std::vector<double> > windows; // misses per access in every window, per level
+	byte zeros[LINESIZE]; // data for replayed writes, traces carry no values
+
+	static std::uint64_t Misses(CacheBase* level)
+	{
+		level->Tally();
+		return (std::uint64_t)level->readmisses + level->writemisses;
+	}
+};
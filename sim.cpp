@@ -0,0 +1,384 @@
+#include "sim.h"
+#include "intervals.h"
+#include <iostream>
+
+DRAM ram; // dual channel DDR3-1600, see DRAMConfig
+Cache<2048, 16> l3(&ram, L3LATENCY, 3); // 2MB, 16-way set associative (latency 36 cycles, 8MB over 4 cores)
+Cache<512, 8> l2(&l3, L2LATENCY, 2); // 256KB, 8-way set associative (fastest latency 12 cycles)
+Cache<64, 8> l1(&l2, L1LATENCY, 1); // 32KB, 8-way set associative (fastest latency 4 cycles)
+
+#ifdef SIMULATETLB
+CacheBase* levels[] = { &l1, &l2, &l3, &ram };
+MMU mmu(levels, 4); // page walks go through L1, like the Haswell page miss handler
+#endif
+
+#ifdef PROFILEREUSE
+ReuseProfiler profiler; // exact, use e.g. profiler(0.01, 65536) for bounded SHARDS sampling
+#endif
+
+#ifdef RECORDTRACE
+TraceWriter trace(RECORDTRACE);
+#endif
+
+#ifdef SIMQUEUES
+AccessQueues accessQueues;
+#endif
+
+#ifdef LOADCHECKPOINT
+Checkpoint checkpoint; // restored memory pages live in its mapping
+#endif
+
+MissHeatmap heatmap;
+RegionTable regions;
+PlacementTable placements;
+bool simAttribute = false;
+IntervalLog intervals;
+IntervalUnit intervalUnit = INTERVALACCESSES;
+std::uint64_t intervalLength = 0, nextInterval = 0; // nextInterval is the cycle of the next sample
+std::uint64_t intervalCountdown = ~std::uint64_t(0), countdownLength = ~std::uint64_t(0);
+std::uint64_t countedAccesses = 0; // detailed accesses before the current countdown started
+
+std::atomic<SimMode> simMode{ SIMWARM }; // nothing is measured before the first region of interest
+SimMode outsideMode = SIMWARM;
+int roiDepth = 0;
+
+void MissHeatmap::Watch(const void* b, int size, int n)
+{
+	base = reinterpret_cast<std::uintptr_t>(b);
+	cellSize = size;
+	extent = (std::uintptr_t)size * n;
+	for (int l = 0; l < 3; ++l)
+	{
+		counts[l].reset(new std::atomic<std::uint32_t>[n]);
+		for (int i = 0; i < n; ++i)
+			counts[l][i].store(0, std::memory_order_relaxed);
+		most[l].store(0, std::memory_order_relaxed);
+	}
+	cells = n;
+}
+
+void RegionTable::Add(const char* name, std::uintptr_t start, std::size_t bytes)
+{
+	SimRegion r = {};
+	r.name = name;
+	r.start = start;
+	r.end = start + bytes;
+	std::size_t i = 0;
+	while (i < regions.size() && regions[i].start <= start)
+		i++;
+	regions.insert(regions.begin() + i, r);
+	last = nullptr;
+}
+
+std::uintptr_t PlacementTable::Place(std::uintptr_t host, std::size_t bytes)
+{
+	for (const Placement& p : placements)
+		if (p.host == host && p.bytes >= bytes)
+			return p.base;
+	Placement p = { host, bytes, next };
+	placements.push_back(p);
+	next += (bytes + PLACEALIGN - 1) / PLACEALIGN * PLACEALIGN;
+	return p.base;
+}
+
+void RegionTable::PrintStats() const
+{
+	std::uint64_t l1misses = other.misses[0];
+	for (const SimRegion& r : regions)
+		l1misses += r.misses[0];
+
+	std::cout << "Region accesses and misses (L1, L2, L3)" << std::endl;
+	for (std::size_t i = 0; i <= regions.size(); ++i)
+	{
+		const SimRegion& r = i < regions.size() ? regions[i] : other;
+		std::cout << r.name << ": " << r.accesses << " accesses, " << r.misses[0] << " " << r.misses[1] << " " << r.misses[2] << " misses";
+		if (l1misses > 0)
+			std::cout << " (" << 100.0 * r.misses[0] / l1misses << "% of L1 misses)";
+		std::cout << std::endl;
+	}
+}
+
+void SimRegisterRegion(const char* name, const void* start, std::size_t bytes)
+{
+#ifdef SIMQUEUES
+	accessQueues.Flush(); // the simulator thread looks regions up
+#endif
+	regions.Add(name, placements.Translate(reinterpret_cast<std::uintptr_t>(start)), bytes);
+	simAttribute = true;
+}
+
+void SimWatchHeatmap(const void* base, int cellSize, int nrOfCells)
+{
+	heatmap.Watch(reinterpret_cast<const void*>(placements.Translate(reinterpret_cast<std::uintptr_t>(base))), cellSize, nrOfCells);
+	simAttribute = true;
+}
+
+void SimPlace(const void* start, std::size_t bytes)
+{
+#ifdef SIMQUEUES
+	accessQueues.Flush(); // the simulator thread translates through the placements
+#endif
+	placements.Place(reinterpret_cast<std::uintptr_t>(start), bytes);
+}
+
+#ifdef SIMQUEUES
+// a queued access, as READ or WRITE would have simulated it on the application thread
+template<typename T>
+static void SimulateAs(const QueuedAccess& a)
+{
+	if (!a.write)
+	{
+		SimRead<T>(a.address);
+		return;
+	}
+	T value;
+	memcpy(&value, &a.value, sizeof(T));
+	SimWrite<T>(a.address, value);
+}
+
+static void SimulateQueued(const QueuedAccess& a)
+{
+	switch (a.size)
+	{
+	case 1: SimulateAs<std::uint8_t>(a); break;
+	case 2: SimulateAs<std::uint16_t>(a); break;
+	case 4: SimulateAs<std::uint32_t>(a); break;
+	default: SimulateAs<std::uint64_t>(a); break;
+	}
+}
+#endif
+
+void SimInit()
+{
+#ifdef SAMPLETRACE
+	{
+		// on levels of its own with the simulator's geometry, so the run starts cold and its stats leave
+		// the trace out
+		std::unique_ptr<DRAM> memory(new DRAM());
+		std::unique_ptr<decltype(l3)> s3(new decltype(l3)(memory.get(), L3LATENCY, 3));
+		std::unique_ptr<decltype(l2)> s2(new decltype(l2)(s3.get(), L2LATENCY, 2));
+		std::unique_ptr<decltype(l1)> s1(new decltype(l1)(s2.get(), L1LATENCY, 1));
+		CacheBase* hierarchy[] = { s1.get(), s2.get(), s3.get() };
+		SmartsSampler sampler(hierarchy, 3);
+		if (sampler.Run(SAMPLETRACE)) sampler.PrintStats();
+		SimMemory::GetMemory()->Clear(); // the pages the trace touched
+		CacheBase::Clock() = 0; // and the time it took
+	}
+#endif
+#ifdef LOADCHECKPOINT
+	CacheBase* restored[] = { &l1, &l2, &l3, &ram };
+	if (!checkpoint.Restore(LOADCHECKPOINT, restored, 4)) std::cout << "Could not restore " << LOADCHECKPOINT << std::endl;
+#endif
+#ifdef SETSAMPLESHIFT
+	l1.SetSampling(SETSAMPLESHIFT);
+#endif
+#ifdef INTERVALSTATS
+	SimStartIntervals(INTERVALSTATS, INTERVALUNIT, INTERVALLENGTH);
+#endif
+#ifdef SIMQUEUES
+	accessQueues.Start(SIMQUEUES, SimulateQueued);
+#endif
+}
+
+// switch modes, flushing the caches when they are about to be bypassed
+static void SetMode(SimMode mode)
+{
+#ifdef SIMQUEUES
+	accessQueues.Flush(); // accesses queued so far belong to the old mode
+#endif
+	if (mode == SIMBYPASS && simMode.load(std::memory_order_relaxed) != SIMBYPASS)
+		l1.Flush();
+	simMode.store(mode, std::memory_order_relaxed); // ordered before this thread's next push by its release
+}
+
+void SimRoiBegin()
+{
+	if (roiDepth++ == 0)
+		SetMode(SIMDETAILED);
+}
+
+void SimRoiEnd()
+{
+	if (roiDepth > 0 && --roiDepth == 0)
+	{
+#ifdef SIMQUEUES
+		accessQueues.Flush();
+#endif
+		ram.Drain(); // requests of the region are timed inside it
+		SetMode(outsideMode);
+	}
+}
+
+void SimSetOutsideMode(SimMode mode)
+{
+	outsideMode = mode;
+	if (roiDepth == 0)
+		SetMode(mode);
+}
+
+void SimResetStats()
+{
+	l1.ResetStats();
+	l2.ResetStats();
+	l3.ResetStats();
+	ram.ResetStats();
+	regions.ResetStats();
+#ifdef SIMULATETLB
+	mmu.ResetStats();
+#endif
+#ifdef PROFILEREUSE
+	profiler.ResetStats();
+#endif
+}
+
+SimStats SimSnapshotStats()
+{
+	SimStats stats = {};
+	CacheBase* hierarchy[] = { &l1, &l2, &l3, &ram };
+	for (int i = 0; i < 4; ++i)
+	{
+		hierarchy[i]->Tally();
+		SimLevelStats& s = stats.levels[i];
+		s.reads = hierarchy[i]->reads;
+		s.writes = hierarchy[i]->writes;
+		s.readmisses = hierarchy[i]->readmisses;
+		s.writemisses = hierarchy[i]->writemisses;
+		s.cleanevicts = hierarchy[i]->cleanevicts;
+		s.dirtyevicts = hierarchy[i]->dirtyevicts;
+	}
+#ifdef SIMULATETLB
+	stats.translations = mmu.accesses;
+	stats.walks = mmu.walks;
+#endif
+	return stats;
+}
+
+std::uint64_t SimCycles()
+{
+	CacheBase* hierarchy[] = { &l1, &l2, &l3, &ram };
+	std::uint64_t cycles = 0;
+	for (CacheBase* level : hierarchy)
+	{
+		level->Tally();
+		cycles += ((std::uint64_t)level->reads + level->writes) * level->latency;
+	}
+	return cycles;
+}
+
+bool SimStartIntervals(const char* file, int unit, std::uint64_t length)
+{
+	SimStopIntervals();
+	if (length == 0 || !intervals.Start(file))
+		return false;
+
+	intervalUnit = (IntervalUnit)unit;
+	intervalLength = length;
+	nextInterval = SimCycles() + length;
+	countedAccesses = 0;
+	// the check runs as an access starts, so the first one after length accesses triggers it
+	intervalCountdown = countdownLength = intervalUnit == INTERVALACCESSES ? length + 1 : 1;
+	return true;
+}
+
+static void PushInterval(std::uint64_t accesses, std::uint64_t cycles)
+{
+	IntervalSample sample;
+	sample.accesses = accesses;
+	sample.cycles = cycles;
+	sample.stats = SimSnapshotStats();
+	intervals.Push(sample);
+}
+
+void SimStopIntervals()
+{
+	if (intervalLength > 0 && countdownLength - intervalCountdown > 0) // the partial interval at the end, if it has accesses
+		PushInterval(countedAccesses + countdownLength - intervalCountdown, SimCycles());
+	intervals.Stop();
+	intervalLength = 0;
+	intervalCountdown = countdownLength = ~std::uint64_t(0);
+	if (intervals.dropped > 0)
+		std::cout << "Interval samples dropped: " << intervals.dropped << std::endl;
+}
+
+// called when intervalCountdown runs out: sample if an interval ended and set the countdown to the next check.
+// In cycle mode the countdown assumes every access misses all the way to RAM, so a check comes before the
+// interval ends and samples overshoot by little more than one access.
+void SimIntervalCheck()
+{
+	countedAccesses += countdownLength;
+	std::uint64_t cycles = SimCycles();
+	if (intervalUnit == INTERVALACCESSES || cycles >= nextInterval)
+	{
+		PushInterval(countedAccesses - 1, cycles); // the current access is not done yet
+		while (nextInterval <= cycles)
+			nextInterval += intervalLength;
+	}
+
+	if (intervalUnit == INTERVALACCESSES)
+		countdownLength = intervalLength;
+	else
+	{
+		std::uint64_t worst = (std::uint64_t)l1.latency + l2.latency + l3.latency + ram.latency;
+		countdownLength = (nextInterval - cycles) / (worst > 0 ? worst : 1);
+		if (countdownLength == 0)
+			countdownLength = 1;
+	}
+	intervalCountdown = countdownLength;
+}
+
+void SimPrintStats()
+{
+#ifdef SIMQUEUES
+	accessQueues.Stop();
+#endif
+	SimStopIntervals();
+	std::cout << "L1 cache stats" << std::endl;
+	l1.PrintStats();
+	std::cout << std::endl;
+	std::cout << "L2 cache stats" << std::endl;
+	l2.PrintStats();
+	std::cout << std::endl;
+	std::cout << "L3 cache stats" << std::endl;
+	l3.PrintStats();
+	std::cout << std::endl;
+	std::cout << "RAM stats" << std::endl;
+	ram.Drain();
+	ram.PrintStats();
+	std::cout << "Simulated memory: " << SimMemory::GetMemory()->Footprint() / 1024 << "KB" << std::endl;
+	if (!regions.regions.empty())
+	{
+		std::cout << std::endl;
+		regions.PrintStats();
+	}
+#ifdef WRITESETSTATS
+	l1.WriteSetStats("l1sets.csv");
+	l2.WriteSetStats("l2sets.csv");
+	l3.WriteSetStats("l3sets.csv");
+	std::cout << std::endl << "Per set counters written to l1sets.csv, l2sets.csv and l3sets.csv" << std::endl;
+#endif
+#ifdef SIMULATETLB
+	std::cout << std::endl;
+	std::cout << "TLB stats" << std::endl;
+	mmu.PrintStats();
+#endif
+#ifdef SIMPROFILE
+	std::cout << std::endl << "L1 simulator profile" << std::endl;
+	l1.phases.Print();
+	std::cout << std::endl << "L2 simulator profile" << std::endl;
+	l2.phases.Print();
+	std::cout << std::endl << "L3 simulator profile" << std::endl;
+	l3.phases.Print();
+#endif
+#ifdef PROFILEREUSE
+	profiler.WriteHistogram("reuse.csv");
+	profiler.WriteMissRatioCurve("mrc.csv");
+	std::cout << std::endl << "Reuse distances written to reuse.csv and mrc.csv" << std::endl;
+#endif
+#ifdef RECORDTRACE
+	trace.Close();
+#endif
+#ifdef SAVECHECKPOINT
+	CacheBase* saved[] = { &l1, &l2, &l3, &ram };
+	if (Checkpoint::Save(SAVECHECKPOINT, saved, 4)) std::cout << std::endl << "Checkpoint written to " << SAVECHECKPOINT << std::endl;
+#endif
+}
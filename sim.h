@@ -0,0 +1,355 @@
+#pragma once
+#include "cache.h"
+#include "dram.h"
+#include "tlb.h"
+#include "reuse.h"
+#include "sampler.h"
+#include "accessqueue.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(SIMQUEUES) && defined(LOADCHECKPOINT)
+#error "SIMQUEUES reads return host memory, which a checkpoint does not restore: disable one of them"
+#endif
+
+// Based on Intel Core i7 4770K (Haswell) specs and Table 2-3 (page 35) of the
+// Intel 64 and IA-32 Architectures Optimization Reference Manual, September 2014
+// L3 set associativity found at http://www.cpu-world.com/CPUs/Core_i7/Intel-Core%20i7-4770K.html
+// L3 latency found at http://7-cpu.com/cpu/Haswell.html
+#define L1LATENCY 4
+#define L2LATENCY 12
+#define L3LATENCY 36
+
+#define PLACEBASE 0x40000000 // where SimPlace puts the first range, above the patterns' PATTERNBASE
+#define PLACEALIGN 0x200000 // SimPlace aligns every range to this, more than the 128KB an L3 way spans
+
+// how accesses through READ and WRITE are simulated
+enum SimMode
+{
+	SIMDETAILED, // counters, timing and every enabled profiler
+	SIMWARM, // functional warming: contents and replacement state only
+	SIMBYPASS // straight to memory, the caches are flushed when this mode is entered
+};
+
+// counters of one level at some moment, see SimSnapshotStats
+struct SimLevelStats
+{
+	std::uint64_t reads, writes, readmisses, writemisses, cleanevicts, dirtyevicts;
+};
+
+struct SimStats
+{
+	SimLevelStats levels[4]; // L1, L2, L3 and RAM
+	std::uint64_t translations, walks; // zero without SIMULATETLB
+};
+
+// Misses per cache level for every cell of one watched array (e.g. the terrain map), so conflict hot spots
+// show up where they happen. Only the simulation thread counts, readers may look at any time.
+class MissHeatmap
+{
+public:
+	int cells = 0; // 0 while nothing is watched
+
+	void Watch(const void* base, int cellSize, int nrOfCells);
+
+	// count a miss of the cell holding address in the first nrOfLevels levels
+	void Miss(std::uintptr_t address, int nrOfLevels)
+	{
+		std::uintptr_t offset = address - base; // wraps around for addresses below base
+		if (offset >= extent)
+			return;
+		int cell = (int)(offset / cellSize);
+		for (int l = 0; l < nrOfLevels; ++l)
+		{
+			std::uint32_t n = counts[l][cell].load(std::memory_order_relaxed) + 1;
+			counts[l][cell].store(n, std::memory_order_relaxed);
+			if (n > most[l].load(std::memory_order_relaxed))
+				most[l].store(n, std::memory_order_relaxed);
+		}
+	}
+
+	std::uint32_t Misses(int level, int cell) const { return counts[level][cell].load(std::memory_order_relaxed); }
+	std::uint32_t Most(int level) const { return most[level].load(std::memory_order_relaxed); }
+
+private:
+	std::uintptr_t base = 0, extent = 0;
+	int cellSize = 1;
+	std::unique_ptr<std::atomic<std::uint32_t>[]> counts[3]; // L1, L2 and L3
+	std::atomic<std::uint32_t> most[3];
+};
+
+// a named address range with its own counters, see SimRegisterRegion
+struct SimRegion
+{
+	std::string name;
+	std::uintptr_t start, end;
+	std::uint64_t accesses, misses[3]; // misses per level: L1, L2 and L3
+};
+
+// Registered regions sorted by start address, found by binary search behind a one entry cache.
+// Accesses outside every region are counted in other.
+class RegionTable
+{
+public:
+	std::vector<SimRegion> regions;
+	SimRegion other;
+
+	RegionTable() : other() { other.name = "other"; }
+
+	// ranges should not overlap, an address in two of them is counted in the one starting last
+	void Add(const char* name, std::uintptr_t start, std::size_t bytes);
+
+	SimRegion* Find(std::uintptr_t address)
+	{
+		if (last != nullptr && address - last->start < last->end - last->start)
+			return last;
+
+		std::size_t low = 0, high = regions.size(); // first region starting after address
+		while (low < high)
+		{
+			std::size_t mid = (low + high) / 2;
+			if (regions[mid].start <= address) low = mid + 1;
+			else high = mid;
+		}
+		if (low == 0 || address >= regions[low - 1].end)
+			return &other;
+		return last = &regions[low - 1];
+	}
+
+	// count an access that missed in the first nrOfLevels levels
+	void Count(std::uintptr_t address, int nrOfLevels)
+	{
+		SimRegion* r = Find(address);
+		r->accesses++;
+		for (int l = 0; l < nrOfLevels; ++l)
+			r->misses[l]++;
+	}
+
+	void ResetStats()
+	{
+		for (SimRegion& r : regions)
+			r.accesses = r.misses[0] = r.misses[1] = r.misses[2] = 0;
+		other.accesses = other.misses[0] = other.misses[1] = other.misses[2] = 0;
+	}
+
+	void PrintStats() const;
+
+private:
+	SimRegion* last = nullptr; // region of the latest access
+};
+
+// Host ranges the simulator sees at fixed addresses, see SimPlace. Addresses outside every range are
+// simulated as they are.
+class PlacementTable
+{
+public:
+	// the address host is simulated at, placing it at the next free one if it was not placed before
+	std::uintptr_t Place(std::uintptr_t host, std::size_t bytes);
+
+	std::uintptr_t Translate(std::uintptr_t address)
+	{
+		if (address - last.host < last.bytes)
+			return address - last.host + last.base;
+		for (const Placement& p : placements)
+			if (address - p.host < p.bytes)
+			{
+				last = p;
+				return address - p.host + p.base;
+			}
+		return address;
+	}
+
+private:
+	struct Placement
+	{
+		std::uintptr_t host, bytes, base;
+	};
+	std::vector<Placement> placements;
+	Placement last = {}; // placement of the latest access, matches nothing while empty
+	std::uintptr_t next = PLACEBASE;
+};
+
+extern DRAM ram;
+extern Cache<2048, 16> l3;
+extern Cache<512, 8> l2;
+extern Cache<64, 8> l1;
+#ifdef SIMULATETLB
+extern MMU mmu;
+#endif
+#ifdef PROFILEREUSE
+extern ReuseProfiler profiler;
+#endif
+#ifdef RECORDTRACE
+extern TraceWriter trace;
+#endif
+#ifdef SIMQUEUES
+extern AccessQueues accessQueues;
+#endif
+extern std::atomic<SimMode> simMode; // mode of the next access, atomic as the simulator thread reads it with SIMQUEUES
+extern MissHeatmap heatmap;
+extern RegionTable regions;
+extern PlacementTable placements;
+extern bool simAttribute; // the heatmap or regions need to know the levels every access missed in
+extern std::uint64_t intervalCountdown; // detailed accesses until the interval log looks again
+
+// restore a checkpoint, set up sampling etc. as configured in precomp.h
+void SimInit();
+void SimPrintStats();
+
+// Region of interest: accesses inside it are simulated in detail, outside it in the outside mode
+// (SIMWARM unless changed). Regions may nest, stats are never reset implicitly.
+// With SIMQUEUES the accesses the calling thread pushed before a mode change are simulated in the old
+// mode, but those of other workload threads are simulated in whichever mode they meet, so change modes,
+// regions and placements only while every other workload thread is quiescent.
+void SimRoiBegin();
+void SimRoiEnd();
+void SimSetOutsideMode(SimMode mode);
+void SimResetStats();
+SimStats SimSnapshotStats();
+
+// count accesses to [start, start + bytes) and their misses per level apart, under name.
+// With SIMQUEUES register regions before other threads access simulated memory.
+void SimRegisterRegion(const char* name, const void* start, std::size_t bytes);
+void SimWatchHeatmap(const void* base, int cellSize, int nrOfCells);
+
+// Simulate [start, start + bytes) at a fixed address instead of where the host put it, so ASLR and the
+// allocator do not change the sets, banks and rows it maps to from run to run. Ranges are placed one
+// after the other in the order they are first placed. Place a range before accessing it, regions and
+// heatmaps given host addresses afterwards are placed with it.
+void SimPlace(const void* start, std::size_t bytes);
+std::uint64_t SimCycles(); // simulated cycles over all levels so far
+
+// Record a sample of every counter each length accesses or cycles (see IntervalUnit) to file, streamed
+// as CSV or JSON by a background thread. SimPrintStats stops it.
+bool SimStartIntervals(const char* file, int unit, std::uint64_t length);
+void SimStopIntervals();
+void SimIntervalCheck();
+
+// attribute an access to its cell and region, once the levels it missed in have set CacheBase::MissDepth
+inline void SimAttribute(std::uintptr_t address)
+{
+	int levels = CacheBase::MissDepth();
+	if (levels > 0 && heatmap.cells > 0)
+		heatmap.Miss(address, levels);
+	regions.Count(address, levels);
+}
+
+// The hierarchy is physically addressed when translation is simulated. CacheBase::MissDepth holds the
+// levels a detailed access missed in afterwards.
+template<typename T>
+T SimRead(std::uintptr_t address)
+{
+	address = placements.Translate(address);
+	SimMode mode = simMode.load(std::memory_order_relaxed);
+	if (mode == SIMBYPASS)
+	{
+#ifdef SIMULATETLB
+		address = mmu.Lookup(address);
+#endif
+		T value;
+		l1.memory->Read(address, sizeof(T), reinterpret_cast<byte*>(&value));
+		return value;
+	}
+	if (mode == SIMWARM)
+	{
+#ifdef SIMULATETLB
+		address = mmu.Translate<false>(address);
+#endif
+		return l1.WarmData<T>(address);
+	}
+
+	if (--intervalCountdown == 0)
+		SimIntervalCheck();
+	std::uintptr_t virtualAddress = address;
+#ifdef SIMULATETLB
+	address = mmu.Translate(address);
+#endif
+#ifdef PROFILEREUSE
+	profiler.Access(address);
+#endif
+#ifdef RECORDTRACE
+	trace.Write(address, sizeof(T), false);
+#endif
+	CacheBase::MissDepth() = 0; // after translation, page walks are not part of the access
+	T value = l1.ReadData<T>(address);
+	if (simAttribute)
+		SimAttribute(virtualAddress);
+	return value;
+}
+
+template<typename T>
+void SimWrite(std::uintptr_t address, T value)
+{
+	address = placements.Translate(address);
+	SimMode mode = simMode.load(std::memory_order_relaxed);
+	if (mode == SIMBYPASS)
+	{
+#ifdef SIMULATETLB
+		address = mmu.Lookup(address);
+#endif
+		l1.memory->Write(address, sizeof(T), reinterpret_cast<byte*>(&value));
+		return;
+	}
+	if (mode == SIMWARM)
+	{
+#ifdef SIMULATETLB
+		address = mmu.Translate<false>(address);
+#endif
+		l1.WarmWrite(address, value);
+		return;
+	}
+
+	if (--intervalCountdown == 0)
+		SimIntervalCheck();
+	std::uintptr_t virtualAddress = address;
+#ifdef SIMULATETLB
+	address = mmu.Translate(address);
+#endif
+#ifdef PROFILEREUSE
+	profiler.Access(address);
+#endif
+#ifdef RECORDTRACE
+	trace.Write(address, sizeof(T), true);
+#endif
+	CacheBase::MissDepth() = 0;
+	l1.WriteData(address, value);
+	if (simAttribute)
+		SimAttribute(virtualAddress);
+}
+
+// Simulated loads and stores. With SIMQUEUES and the queues running they go to host memory and the
+// simulator thread sees them later, see AccessQueues, otherwise they are simulated right away.
+// Host memory holds the data then: a queued READ returns what the host has at address, never what
+// simulated memory holds, so it must only be used on real, writable host memory.
+template<typename T>
+T READ(std::uintptr_t address)
+{
+#ifdef SIMQUEUES
+	if (accessQueues.running)
+	{
+		T value = *reinterpret_cast<T*>(address);
+		accessQueues.Push(address, sizeof(T), false, 0);
+		return value;
+	}
+#endif
+	return SimRead<T>(address);
+}
+
+template<typename T>
+void WRITE(std::uintptr_t address, T value)
+{
+#ifdef SIMQUEUES
+	if (accessQueues.running)
+	{
+		static_assert(sizeof(T) <= sizeof(std::uint64_t), "queued accesses carry at most 8 bytes");
+		*reinterpret_cast<T*>(address) = value;
+		std::uint64_t bytes = 0;
+		memcpy(&bytes, &value, sizeof(T));
+		accessQueues.Push(address, sizeof(T), true, bytes);
+		return;
+	}
+#endif
+	SimWrite<T>(address, value);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+// simulator options, shared by the game and cachesim
+// #define SIMULATETLB
+// #define CLASSIFYMISSES
+// #define PROFILEREUSE
+// #define SIMQUEUES QUEUEROUNDROBIN // simulate on a thread of its own fed by per-thread rings, or QUEUETIMESTAMP (reads use host memory, no LOADCHECKPOINT)
+// #define SIMPROFILE // time the phases of every level's accesses, see simprofile.h
+// #define WRITESETSTATS // per set accesses and misses to l1sets.csv, l2sets.csv and l3sets.csv
+// #define SETSAMPLESHIFT 5 // simulate 1 in 2^SETSAMPLESHIFT cache sets
+// #define RECORDTRACE "trace.bin" // write every access L1 sees to this file
+// #define SAMPLETRACE "trace.bin" // replay this trace with SMARTS sampling at startup, the run itself starts cold
+// #define SAVECHECKPOINT "warm.ckpt" // save the hierarchy and memory when the run completes
+// #define LOADCHECKPOINT "warm.ckpt" // start from a saved hierarchy instead of cold caches
+// #define INTERVALSTATS "intervals.csv" // stream counters per interval, JSON if the name ends in .json
+#define INTERVALUNIT INTERVALACCESSES // or INTERVALCYCLES
+#define INTERVALLENGTH 100000
@@ -0,0 +1,123 @@
+#pragma once
+#include <stdint.h>
+#include <cstdint>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unordered_map>
+#include <vector>
+
+typedef unsigned char byte; // as in template.h, which the headless build does not include
+
+#define PAGESIZE 4096
+#define CHUNKSIZE (2 * 1024 * 1024) // pages are carved out of chunks of this size
+
+// Sparse simulated physical memory backing the last level of the hierarchy.
+// Pages are zeroed and allocated on first touch, so any 64-bit address can be simulated
+// without the host owning it.
+class SimMemory
+{
+public:
+	SimMemory() { }
+	~SimMemory()
+	{
+		for (byte* chunk : chunks)
+			free(chunk);
+	}
+
+	// memory shared by every hierarchy that does not bring its own
+	static SimMemory* GetMemory()
+	{
+		static SimMemory memory;
+		return &memory;
+	}
+
+	// get the data of the page containing address, lines never cross a page
+	byte* Page(std::uint64_t address)
+	{
+		std::uint64_t page = address / PAGESIZE;
+		if (page == lastPage)
+			return lastData;
+
+		byte*& data = pages[page];
+		if (data == nullptr)
+			data = Allocate();
+
+		lastPage = page;
+		lastData = data;
+		return data;
+	}
+
+	// get a pointer to the byte at address, valid for the rest of its page
+	byte* Data(std::uint64_t address)
+	{
+		return Page(address) + (address & (PAGESIZE - 1));
+	}
+
+	void Read(std::uint64_t address, int nrOfBytes, byte* data)
+	{
+		memcpy(data, Data(address), nrOfBytes);
+	}
+
+	void Write(std::uint64_t address, int nrOfBytes, const byte* data)
+	{
+		memcpy(Data(address), data, nrOfBytes);
+	}
+
+	// number of bytes in touched pages
+	std::uint64_t Footprint() const { return (std::uint64_t)pages.size() * PAGESIZE; }
+
+	// page number to data of every touched page
+	const std::unordered_map<std::uint64_t, byte*>& Pages() const { return pages; }
+
+	// use data owned by someone else (e.g. a mapped checkpoint) as the page, it must outlive this memory
+	void Attach(std::uint64_t page, byte* data)
+	{
+		pages[page] = data;
+		lastPage = ~std::uint64_t(0);
+	}
+
+	// forget every page, as if nothing was ever touched
+	void Clear()
+	{
+		for (byte* chunk : chunks)
+			free(chunk);
+		chunks.clear();
+		pages.clear();
+		next = nullptr;
+		left = 0;
+		lastPage = ~std::uint64_t(0);
+		lastData = nullptr;
+	}
+
+private:
+	std::unordered_map<std::uint64_t, byte*> pages;
+	std::vector<byte*> chunks;
+	byte* next = nullptr; // first unused page in the current chunk
+	std::size_t left = 0; // bytes left in the current chunk
+	std::uint64_t lastPage = ~std::uint64_t(0);
+	byte* lastData = nullptr;
+
+	SimMemory(const SimMemory&);
+	SimMemory& operator=(const SimMemory&);
+
+	byte* Allocate()
+	{
+		if (left == 0)
+		{
+			next = static_cast<byte*>(calloc(CHUNKSIZE, 1));
+			if (next == nullptr) // nothing to simulate with, and the caller has no way to recover
+			{
+				fprintf(stderr, "Out of host memory for simulated pages after %llu MB\n", (unsigned long long)(chunks.size() * (CHUNKSIZE / (1024 * 1024))));
+				abort();
+			}
+			chunks.push_back(next);
+			left = CHUNKSIZE;
+		}
+
+		byte* page = next;
+		next += PAGESIZE;
+		left -= PAGESIZE;
+		return page;
+	}
+};
@@ -0,0 +1,123 @@
+#pragma once
+#include <cstdint>
+#include <iostream>
+#include <iomanip>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// Self-profiling of the simulator (SIMPROFILE in simconfig.h): every level times the phases of the
+// accesses it handles with the time stamp counter and adds them to one bin per phase. Only one in
+// PROFILESAMPLE accesses of a level is timed, so a run with it enabled stays close to full speed;
+// the time of a phase is estimated from those. Without SIMPROFILE the macros below are empty.
+
+#define PROFILESAMPLE 64 // time one in this many accesses of a level
+
+enum ProfilePhase
+{
+	PHASELOOKUP, // finding the line in its set
+	PHASEREPLACE, // updating the PLRU tree
+	PHASEFILL, // placing a fetched line
+	PHASEEVICT, // picking the victim and counting it
+	PHASENEXT, // reads and write backs in the next level or memory, including the time the levels below take
+	PHASESTATS, // counters, set stats, hit positions and miss classification
+	PHASES
+};
+
+// time stamp counter ticks, nanoseconds where there is no rdtsc
+inline std::uint64_t ProfileStamp()
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// ticks between two back to back time stamps, the least of many, measured on the first call.
+// Every timed phase includes this once, PhaseProfile takes it off again; the stamps the levels below
+// take during PHASENEXT stay in it.
+inline std::uint64_t ProfileOverhead()
+{
+	static const std::uint64_t overhead = []()
+	{
+		std::uint64_t least = ~std::uint64_t(0);
+		for (int i = 0; i < 1000; ++i)
+		{
+			std::uint64_t start = ProfileStamp();
+			std::uint64_t end = ProfileStamp();
+			if (end - start < least)
+				least = end - start;
+		}
+		return least;
+	}();
+	return overhead;
+}
+
+class PhaseProfile
+{
+public:
+	std::uint64_t ticks[PHASES] = {}, sampled = 0; // of the timed accesses, without the time stamp overhead
+	bool active = false; // the current access is timed
+	std::uint64_t overhead = ProfileOverhead(); // taken off every phase
+
+	// start of an access: a time stamp if it is timed, 0 if not
+	std::uint64_t Begin()
+	{
+		if (--countdown != 0)
+			return active = false, 0;
+		countdown = PROFILESAMPLE;
+		active = true;
+		sampled++;
+		return ProfileStamp();
+	}
+
+	// add the time since start to phase and return the end of it, the start of the next phase
+	std::uint64_t Add(ProfilePhase phase, std::uint64_t start)
+	{
+		std::uint64_t now = ProfileStamp();
+		std::uint64_t elapsed = now - start;
+		ticks[phase] += elapsed > overhead ? elapsed - overhead : 0;
+		return now;
+	}
+
+	void Reset()
+	{
+		for (int i = 0; i < PHASES; ++i)
+			ticks[i] = 0;
+		sampled = 0;
+	}
+
+	void Print() const
+	{
+		static const char* names[PHASES] = { "Lookup", "Replacement update", "Fill", "Eviction", "Next level", "Stats" };
+		std::uint64_t total = 0;
+		for (int i = 0; i < PHASES; ++i)
+			total += ticks[i];
+		std::cout << "Timed accesses: " << sampled << " (1 in " << PROFILESAMPLE << "), " << overhead << " ticks of time stamp overhead taken off every phase" << std::endl;
+		if (sampled == 0 || total == 0)
+			return;
+		for (int i = 0; i < PHASES; ++i)
+			std::cout << names[i] << ": " << std::fixed << std::setprecision(1) << (double)ticks[i] / sampled << " ticks per access ("
+				<< 100.0 * ticks[i] / total << "%)" << std::defaultfloat << std::endl;
+	}
+
+private:
+	std::uint32_t countdown = PROFILESAMPLE;
+};
+
+#ifdef SIMPROFILE
+#define PROFILEBEGIN(t) std::uint64_t t = phases.Begin() // in Read and Write, which every access of a level goes through
+#define PROFILECONTINUE(t) std::uint64_t t = phases.active ? ProfileStamp() : 0 // in helpers of a timed access
+#define PROFILEPHASE(phase, t) if (t != 0) t = phases.Add(phase, t)
+#define PROFILESKIP(t) if (t != 0) t = ProfileStamp() // after a call that times itself
+#else
+#define PROFILEBEGIN(t)
+#define PROFILECONTINUE(t)
+#define PROFILEPHASE(phase, t)
+#define PROFILESKIP(t)
+#endif
@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+#include <cstdint>
+#include <string.h>
+#include <vector>
+
+// Single producer, single consumer triple buffer: the producer fills its back buffer and swaps it with
+// the middle one, the consumer swaps its front buffer with the middle one when that holds something new.
+// Neither side ever waits and the consumer always sees a complete buffer.
+template<typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer(int n) : middle(1), back(0), front(2)
+	{
+		for (int i = 0; i < 3; ++i)
+			buffers[i].resize(n);
+	}
+
+	// producer side: fill this, then publish it
+	T* Back() { return buffers[back].data(); }
+
+	void Publish() { back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & ~FRESH; }
+
+	// consumer side: the latest published buffer, valid until the next call
+	const T* Front()
+	{
+		if (middle.load(std::memory_order_relaxed) & FRESH)
+			front = middle.exchange(front, std::memory_order_acq_rel) & ~FRESH;
+		return buffers[front].data();
+	}
+
+private:
+	static const int FRESH = 4; // set in middle when the producer published since the last swap
+	std::vector<T> buffers[3];
+	std::atomic<int> middle;
+	int back, front;
+};
+
+// Sequence lock for a trivially copyable T with one writer: readers retry while a write is in progress.
+// The value is stored as atomic words, so a reader racing a writer gets a torn copy it then throws away.
+template<typename T>
+class SeqLock
+{
+public:
+	SeqLock() : sequence(0)
+	{
+		for (std::atomic<std::uint64_t>& w : words)
+			w.store(0, std::memory_order_relaxed);
+	}
+
+	void Write(const T& value)
+	{
+		std::uint64_t copy[WORDS] = {};
+		memcpy(copy, &value, sizeof(T));
+		unsigned s = sequence.load(std::memory_order_relaxed);
+		sequence.store(s + 1, std::memory_order_relaxed); // odd while writing
+		std::atomic_thread_fence(std::memory_order_release);
+		for (int i = 0; i < WORDS; ++i)
+			words[i].store(copy[i], std::memory_order_relaxed);
+		sequence.store(s + 2, std::memory_order_release);
+	}
+
+	T Read() const
+	{
+		std::uint64_t copy[WORDS];
+		unsigned before, after;
+		do
+		{
+			before = sequence.load(std::memory_order_acquire);
+			for (int i = 0; i < WORDS; ++i)
+				copy[i] = words[i].load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			after = sequence.load(std::memory_order_relaxed);
+		} while ((before & 1) || before != after);
+
+		T value;
+		memcpy(&value, copy, sizeof(T));
+		return value;
+	}
+
+private:
+	static const int WORDS = (sizeof(T) + 7) / 8;
+	std::atomic<unsigned> sequence;
+	std::atomic<std::uint64_t> words[WORDS];
+};
@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Single producer, single consumer ring of N elements of T, N a power of 2. Push and Front never wait,
+// each side keeps a copy of the other side's index and only reloads it when the ring looks full or empty.
+template<typename T, int N>
+class SpscRing
+{
+public:
+	// producer only, false when the ring is full
+	bool Push(const T& e)
+	{
+		std::uint64_t t = tail.load(std::memory_order_relaxed);
+		if (t - headCache == N)
+		{
+			headCache = head.load(std::memory_order_acquire);
+			if (t - headCache == N)
+				return false;
+		}
+		slots[t & (N - 1)] = e;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	// consumer only, the oldest element or nullptr when the ring is empty
+	const T* Front()
+	{
+		std::uint64_t h = head.load(std::memory_order_relaxed);
+		if (h == tailCache)
+		{
+			tailCache = tail.load(std::memory_order_acquire);
+			if (h == tailCache)
+				return nullptr;
+		}
+		return &slots[h & (N - 1)];
+	}
+
+	// consumer only, once done with the front element
+	void Pop() { head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+	bool Empty() const { return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire); }
+
+private:
+	static_assert(N > 0 && (N & (N - 1)) == 0, "the ring size must be a power of 2");
+
+	alignas(64) std::atomic<std::uint64_t> tail{ 0 }; // producer side
+	std::uint64_t headCache = 0;
+	alignas(64) std::atomic<std::uint64_t> head{ 0 }; // consumer side
+	std::uint64_t tailCache = 0;
+	alignas(64) T slots[N];
+};
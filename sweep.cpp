@@ -0,0 +1,258 @@
+#include "sweep.h"
+#include "sim.h"
+#include "jobs.h"
+#include "tagcache.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+
+using namespace Tmpl8;
+
+struct SweepConfig
+{
+	std::string name;
+	int kb[3], ways[3]; // L1, L2 and L3
+};
+
+static int Sets(const SweepConfig& c, int level) { return c.kb[level] * 1024 / (LINESIZE * c.ways[level]); }
+
+// One level of the configurations that agree on it and on every level above it, it only runs once for
+// all of them. What it sends down is recorded per chunk and is the input of the nodes of the next level.
+// The level points at below, so a node stays where it was made.
+struct SweepNode
+{
+	int parent; // node of the level above, -1 for the first simulated level
+	TagLevel below, level; // below is memory for the last level
+	std::vector<std::uint64_t> out; // fills and write backs of the current chunk, as in Decode
+
+	SweepNode(int p, int sets, int ways, bool last) : parent(p), level(sets, ways, &below)
+	{
+		if (!last)
+			below.record = &out;
+	}
+};
+
+static bool PowerOf2(int n) { return n > 0 && (n & (n - 1)) == 0; }
+
+static bool Valid(const SweepConfig& c)
+{
+	for (int l = 0; l < 3; ++l)
+		if (!PowerOf2(c.ways[l]) || c.ways[l] > 32 || c.kb[l] <= 0 || c.kb[l] * 1024 % (LINESIZE * c.ways[l]) != 0 || !PowerOf2(Sets(c, l)))
+			return false;
+	return true;
+}
+
+// every combination of a few sizes and associativities per level, 216 in all
+static std::vector<SweepConfig> Grid()
+{
+	static const int l1kb[] = { 32, 64 }, l1ways[] = { 4, 8 };
+	static const int l2kb[] = { 256, 512, 1024 }, l2ways[] = { 4, 8, 16 };
+	static const int l3kb[] = { 2048, 4096, 8192 }, l3ways[] = { 8, 16 };
+	std::vector<SweepConfig> grid;
+	for (int a : l1kb) for (int b : l1ways) for (int c : l2kb) for (int d : l2ways) for (int e : l3kb) for (int f : l3ways)
+	{
+		SweepConfig config = { "", { a, c, e }, { b, d, f } };
+		std::ostringstream name;
+		name << a << "k" << b << "-" << c << "k" << d << "-" << e << "k" << f;
+		config.name = name.str();
+		grid.push_back(config);
+	}
+	return grid;
+}
+
+static bool ReadConfigs(const char* file, std::vector<SweepConfig>& configs)
+{
+	std::ifstream in(file);
+	if (!in)
+	{
+		std::cerr << "Could not read " << file << std::endl;
+		return false;
+	}
+	std::string line;
+	for (int n = 1; std::getline(in, line); ++n)
+	{
+		std::istringstream fields(line);
+		SweepConfig c;
+		if (line.empty() || line[0] == '#' || !(fields >> c.name))
+			continue;
+		if (!(fields >> c.kb[0] >> c.ways[0] >> c.kb[1] >> c.ways[1] >> c.kb[2] >> c.ways[2]) || !Valid(c))
+		{
+			std::cerr << file << ":" << n << ": expected name and size in KB and ways of three levels, with power of 2 sets and ways up to 32" << std::endl;
+			return false;
+		}
+		configs.push_back(c);
+	}
+	return true;
+}
+
+// The next chunk of the trace as line numbers shifted left by one with the write bit below them, empty
+// at the end. A job, so the next chunk is decoded while the levels run the current one.
+struct DecodeJob : Job
+{
+	TraceReader* in = nullptr;
+	std::vector<std::uint64_t>* chunk = nullptr;
+	std::vector<TraceRecord> records = std::vector<TraceRecord>(TRACEBUFFER);
+
+	void Main()
+	{
+		chunk->clear();
+		int n;
+		while (chunk->size() < SWEEPCHUNK && (n = in->Read(records.data(), (int)std::min<std::size_t>(TRACEBUFFER, SWEEPCHUNK - chunk->size()))) > 0)
+			for (int i = 0; i < n; ++i)
+				chunk->push_back(records[i].address / LINESIZE << 1 | (records[i].write & 1));
+	}
+};
+
+bool RunSweep(const char* trace, const char* configFile, unsigned int threads, int first)
+{
+	std::vector<SweepConfig> configs;
+	if (configFile == nullptr) configs = Grid();
+	else if (!ReadConfigs(configFile, configs)) return false;
+	if (configs.empty())
+	{
+		std::cerr << "No configurations to sweep" << std::endl;
+		return false;
+	}
+	first--; // from here on 0 is L1
+	TraceReader in(trace);
+	if (!in.IsOpen())
+	{
+		std::cerr << "Could not read " << trace << std::endl;
+		return false;
+	}
+
+	// configurations with the same levels down to level l share the node of level l
+	std::vector<std::unique_ptr<SweepNode>> nodes[3];
+	std::map<std::vector<int>, int> known[3]; // parent, size and ways to node
+	std::vector<std::vector<int>> paths(configs.size(), std::vector<int>(3, -1));
+	for (std::size_t i = 0; i < configs.size(); ++i)
+	{
+		const SweepConfig& c = configs[i];
+		for (int l = first, parent = -1; l < 3; parent = paths[i][l++])
+		{
+			std::vector<int> key = { parent, c.kb[l], c.ways[l] };
+			auto found = known[l].find(key);
+			if (found == known[l].end())
+			{
+				found = known[l].emplace(key, (int)nodes[l].size()).first;
+				nodes[l].emplace_back(new SweepNode(parent, Sets(c, l), c.ways[l], l == 2));
+			}
+			paths[i][l] = found->second;
+		}
+	}
+
+	if (threads == 0)
+		threads = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1;
+	if (JobManager::GetJobManager() == nullptr || JobManager::GetJobManager()->GetNumThreads() != threads)
+		JobManager::CreateJobManager(threads);
+	JobManager* jobs = JobManager::GetJobManager();
+
+	// two chunks in memory: the levels run one while the other is decoded
+	auto start = std::chrono::steady_clock::now();
+	std::chrono::duration<double> waited(0); // for decoding, after the levels were done with a chunk
+	std::vector<std::uint64_t> chunks[2];
+	chunks[0].reserve(SWEEPCHUNK), chunks[1].reserve(SWEEPCHUNK);
+	DecodeJob decode;
+	decode.in = &in, decode.chunk = &chunks[0];
+	decode.Main();
+	std::uint64_t accesses = 0;
+	for (int k = 0; !chunks[k & 1].empty(); ++k)
+	{
+		const std::vector<std::uint64_t>& chunk = chunks[k & 1];
+		accesses += chunk.size();
+		JobGroup next;
+		decode.chunk = &chunks[(k + 1) & 1];
+		jobs->Spawn(&decode, next);
+		for (int l = first; l < 3; ++l) // a level needs the output of the one above for this chunk
+			jobs->ParallelFor(0, (int)nodes[l].size(), [&](int i)
+			{
+				SweepNode& node = *nodes[l][i];
+				const std::vector<std::uint64_t>& input = node.parent < 0 ? chunk : nodes[l - 1][node.parent]->out;
+				node.out.clear();
+				for (std::uint64_t a : input)
+					node.level.Access(a >> 1, (a & 1) != 0);
+			});
+		auto done = std::chrono::steady_clock::now();
+		jobs->Wait(next);
+		waited += std::chrono::steady_clock::now() - done;
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	std::uint64_t simulated = 0, unshared = 0; // accesses to a level, with and without sharing
+	for (int l = first; l < 3; ++l)
+		for (const std::unique_ptr<SweepNode>& node : nodes[l])
+			simulated += node->level.reads + node->level.writes;
+	std::cout << "config,l1kb,l1ways,l2kb,l2ways,l3kb,l3ways,accesses,l1misses,l2misses,l3misses,l1missrate,l2missrate,l3missrate,memreads,memwrites" << std::endl;
+	for (std::size_t i = 0; i < configs.size(); ++i)
+	{
+		const SweepConfig& c = configs[i];
+		std::cout << c.name;
+		for (int l = 0; l < 3; ++l)
+			std::cout << "," << c.kb[l] << "," << c.ways[l];
+		std::cout << "," << accesses;
+		for (int l = 0; l < 3; ++l) // empty for the levels above the trace
+		{
+			std::cout << ",";
+			if (l >= first)
+				std::cout << nodes[l][paths[i][l]]->level.readmisses + nodes[l][paths[i][l]]->level.writemisses;
+		}
+		for (int l = 0; l < 3; ++l)
+		{
+			std::cout << ",";
+			if (l < first)
+				continue;
+			const TagLevel& level = nodes[l][paths[i][l]]->level;
+			std::uint64_t n = level.reads + level.writes;
+			std::cout << (n > 0 ? (double)(level.readmisses + level.writemisses) / n : 0.0);
+			unshared += n;
+		}
+		const TagLevel& memory = nodes[2][paths[i][2]]->below;
+		std::cout << "," << memory.reads << "," << memory.writes << std::endl;
+	}
+	std::cerr << configs.size() << " configurations over " << accesses << " accesses in " << elapsed.count() << "s on " << threads << " threads ("
+		<< waited.count() << "s waiting for the trace, " << simulated << " level accesses instead of " << unshared << ", "
+		<< simulated / elapsed.count() / 1e6 << "M level accesses/s)" << std::endl;
+	return true;
+}
+
+bool WriteFiltered(const char* trace, int first, int last, const char* file)
+{
+	TraceReader in(trace);
+	if (!in.IsOpen())
+	{
+		std::cerr << "Could not read " << trace << std::endl;
+		return false;
+	}
+	TraceWriter out(file);
+	if (!out.IsOpen())
+	{
+		std::cerr << "Could not write " << file << std::endl;
+		return false;
+	}
+
+	// the simulated geometry as tag-only levels, the regression corpus checks that they agree
+	std::vector<std::uint64_t> filtered;
+	TagLevel below, t3(l3.sets, l3.ways, &below), t2(l2.sets, l2.ways, last == 2 ? &below : &t3), t1(l1.sets, l1.ways, last == 1 ? &below : &t2);
+	TagLevel* levels[] = { &t1, &t2, &t3 };
+	below.record = &filtered;
+
+	static TraceRecord records[TRACEBUFFER];
+	int n;
+	while ((n = in.Read(records, TRACEBUFFER)) > 0)
+	{
+		for (int i = 0; i < n; ++i)
+			levels[first - 1]->Access(records[i].address / LINESIZE, records[i].write != 0);
+		for (std::uint64_t a : filtered)
+			out.Write((a >> 1) * LINESIZE, LINESIZE, (a & 1) != 0);
+		filtered.clear();
+	}
+	std::cerr << "L" << first << " to L" << last << " passed " << below.reads + below.writes << " of " << levels[first - 1]->reads + levels[first - 1]->writes
+		<< " accesses on (" << below.reads << " fills, " << below.writes << " write backs)" << std::endl;
+	return true;
+}
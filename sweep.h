@@ -0,0 +1,26 @@
+#pragma once
+
+// Design-space sweep: one trace through many hierarchies in one process. The trace is decoded into
+// shared read-only chunks of line numbers, and every configuration runs its own tag-only hierarchy
+// (tagcache.h) over them. The chunks are handed out one at a time to all workers, so a chunk is still in
+// the host's caches while the other configurations read it, and the next chunk is decoded meanwhile:
+// only two chunks are in memory, whatever the length of the trace. Workers come from the work-stealing
+// JobManager. Prints one CSV row per configuration and returns false when the trace or the configuration
+// file can not be used.
+//
+// Configurations that agree on L1 share its simulation, and those that also agree on L2 share that too:
+// a shared level records what it sends down for a chunk, its fills and dirty write backs in order, and
+// the levels below it replay that filtered stream instead of the trace. Varying only L3 then runs L1 and
+// L2 once. The stream leaving a level can also go to disk as a trace of line sized accesses, for later
+// runs that start at the level below it.
+
+#define SWEEPCHUNK (1 << 18) // accesses per shared chunk, 2MB of line numbers, two of them in memory
+
+// configs holds lines of "name l1KB l1ways l2KB l2ways l3KB l3ways", nullptr sweeps a built-in grid
+// around the simulated Haswell. threads 0 uses every hardware thread. The trace is what level first (1
+// to 3) sees, the levels above it are not simulated and get empty columns.
+bool RunSweep(const char* trace, const char* configs, unsigned int threads, int first = 1);
+
+// run trace, as seen by level first, through levels first to last of the simulated geometry and write
+// their filtered stream, what reaches the level below last, to file
+bool WriteFiltered(const char* trace, int first, int last, const char* file);
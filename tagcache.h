@@ -0,0 +1,96 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Tag-only cache level with its geometry chosen at run time, for sweeping many hierarchies at once.
+// It is Cache from cache.h without the data: a miss reads the line from the next level first, then
+// takes the lowest invalid way or else the PLRUtree victim, writes a dirty victim back, and a write
+// dirties the line it hits or allocates. The tree bits of a set are packed the way PLRUtree::getBits
+// packs them, so up to 32 ways fit in one word. The regression corpus runs it next to Cache and the
+// heap-ordered reference model. Sets and ways are powers of 2. A level without sets stands for memory,
+// and can record what reaches it: the fills and write backs of the level above, in order.
+class TagLevel
+{
+public:
+	std::uint64_t reads = 0, writes = 0, readmisses = 0, writemisses = 0, cleanevicts = 0, dirtyevicts = 0;
+	int sets, ways;
+	std::vector<std::uint64_t>* record = nullptr; // memory only: every access as line << 1 | write
+
+	TagLevel(int nrOfSets = 0, int nrOfWays = 0, TagLevel* next = nullptr)
+		: sets(nrOfSets), ways(nrOfWays), nextLevel(next), lines((std::size_t)nrOfSets * nrOfWays), plru(nrOfSets) { }
+
+	// access to the line with number line (address / LINESIZE)
+	void Access(std::uint64_t line, bool write)
+	{
+		(write ? writes : reads)++;
+		if (sets == 0)
+		{
+			if (record != nullptr)
+				record->push_back(line << 1 | (write ? 1 : 0));
+			return;
+		}
+
+		std::uint32_t set = (std::uint32_t)(line & (sets - 1));
+		std::uint64_t* row = &lines[(std::size_t)set * ways];
+		std::uint64_t wanted = line << 2 | VALID;
+		int way = 0;
+		while (way < ways && (row[way] & ~DIRTY) != wanted)
+			way++;
+		if (way == ways)
+		{
+			(write ? writemisses : readmisses)++;
+			nextLevel->Access(line, false);
+			way = Victim(set, row);
+			if (row[way] & VALID)
+			{
+				bool dirty = (row[way] & DIRTY) != 0;
+				(dirty ? dirtyevicts : cleanevicts)++;
+				if (dirty)
+					nextLevel->Access(row[way] >> 2, true);
+			}
+			row[way] = wanted;
+		}
+		Touch(set, way);
+		if (write)
+			row[way] |= DIRTY;
+	}
+
+private:
+	static const std::uint64_t VALID = 1, DIRTY = 2; // low bits of a way, the line number above them
+
+	TagLevel* nextLevel;
+	std::vector<std::uint64_t> lines; // way w of set s at s * ways + w
+	std::vector<std::uint32_t> plru; // per set, bit t is node t of PLRUtree::binaryTree
+
+	// PLRUtree::getOverwriteTarget on the packed bits: starting at the root, node ways / 2, a set bit
+	// sends the search to the upper ways. Invalid ways go first, as Cache::LoadData fills them in order.
+	int Victim(std::uint32_t set, const std::uint64_t* row) const
+	{
+		for (int w = 0; w < ways; ++w)
+			if (!(row[w] & VALID))
+				return w;
+		if (ways == 1)
+			return 0;
+		std::uint32_t bits = plru[set];
+		int t = ways / 2;
+		for (int s = ways / 4; s > 0; s /= 2)
+			t += (bits >> t) & 1 ? s : -s;
+		return (bits >> t) & 1 ? t : t - 1;
+	}
+
+	// PLRUtree::setPath on the packed bits: node t on the way down gets set when way is below t
+	void Touch(std::uint32_t set, int way)
+	{
+		std::uint32_t bits = plru[set];
+		int t = ways / 2;
+		for (int s = ways / 4;; s /= 2)
+		{
+			bool below = way < t;
+			bits = below ? bits | (1u << t) : bits & ~(1u << t);
+			if (s == 0)
+				break;
+			t += below ? -s : s;
+		}
+		plru[set] = bits;
+	}
+};
@@ -16,8 +16,6 @@
 
 namespace Tmpl8 { 
 
-double timer::inv_freq = 1;
-
 void NotifyUser( char* s )
 {
 	HWND hApp = FindWindow( NULL, "Template" );
@@ -8,6 +8,7 @@
 #include "emmintrin.h"
 #include "immintrin.h"
 #include "stdio.h"
+#include <chrono>
 #include "windows.h"
 #include "glm/glm.hpp"
 
@@ -57,27 +58,17 @@ namespace Tmpl8 {
 #define unlikely(expr) __builtin_expect((expr),false)
 #endif
 
+// milliseconds since construction or reset, on any platform
 struct timer 
 { 
-	typedef long long value_type; 
-	static double inv_freq; 
-	value_type start; 
-	timer() : start( get() ) { init(); } 
-	float elapsed() const { return (float)((get() - start) * inv_freq); } 
-	static value_type get() 
-	{ 
-		LARGE_INTEGER c; 
-		QueryPerformanceCounter( &c ); 
-		return c.QuadPart; 
-	} 
-	static double to_time(const value_type vt) { return double(vt) * inv_freq; } 
-	void reset() { start = get(); }
-	static void init() 
-	{ 
-		LARGE_INTEGER f; 
-		QueryPerformanceFrequency( &f ); 
-		inv_freq = 1000./double(f.QuadPart); 
-	} 
+	typedef std::chrono::steady_clock clock;
+	typedef long long value_type; // nanoseconds
+	clock::time_point start;
+	timer() : start( clock::now() ) {} 
+	float elapsed() const { return std::chrono::duration<float, std::milli>( clock::now() - start ).count(); } 
+	static value_type get() { return std::chrono::duration_cast<std::chrono::nanoseconds>( clock::now().time_since_epoch() ).count(); } 
+	static double to_time( const value_type vt ) { return double( vt ) * 1e-6; } 
+	void reset() { start = clock::now(); }
 };
 
 #define BADFLOAT(x) ((*(uint*)&x & 0x7f000000) == 0x7f000000)
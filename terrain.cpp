@@ -0,0 +1,96 @@
+#include "terrain.h"
+#include "sim.h"
+
+// -----------------------------------------------------------
+// Map access
+// -----------------------------------------------------------
+void Map::Clear()
+{
+	memset( map, 0, 513 * 513 * sizeof( int ) );
+}
+
+int Map::Get( int x, int y )
+{
+	return READ<int>(reinterpret_cast<std::uintptr_t>(&map[x + y * 513]));
+}
+
+void Map::Set( int x, int y, int v )
+{
+	WRITE<int>(reinterpret_cast<std::uintptr_t>(&map[x + y * 513]), v);
+	map[x + y * 513] = v; // simulated memory holds the data, this copy is for GetRaw
+}
+
+// -----------------------------------------------------------
+// Initialize the map and the recursion stack
+// -----------------------------------------------------------
+void Terrain::Init( std::uint32_t seed )
+{
+	state = seed ? seed : TERRAINSEED; // xorshift never leaves 0
+	SimPlace( map.GetRawRow( 0 ), 513 * 513 * sizeof( int ) ); // the same simulated addresses on every run
+	SimPlace( task, sizeof( task ) );
+	map.Clear();
+	map.Set( 0, 0, IRand( 256 ) );
+	map.Set( 512, 0, IRand( 256 ) );
+	map.Set( 0, 512, IRand( 256 ) );
+	map.Set( 512, 512, IRand( 256 ) );
+	taskPtr = 0;
+	Push( 0, 0, 512, 512, 256 );
+	SimRegisterRegion( "map", map.GetRawRow( 0 ), 513 * 513 * sizeof( int ) );
+	SimRegisterRegion( "task", task, sizeof( task ) );
+}
+
+// -----------------------------------------------------------
+// xorshift32 random numbers in [0, range)
+// -----------------------------------------------------------
+int Terrain::IRand( int range )
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return (int)(state % range);
+}
+
+// -----------------------------------------------------------
+// Task stack, simulated like the map
+// -----------------------------------------------------------
+void Terrain::Push( int x1, int y1, int x2, int y2, int scale )
+{
+	Task& t = task[taskPtr++];
+	WRITE<int>( reinterpret_cast<std::uintptr_t>(&t.x1), x1 );
+	WRITE<int>( reinterpret_cast<std::uintptr_t>(&t.y1), y1 );
+	WRITE<int>( reinterpret_cast<std::uintptr_t>(&t.x2), x2 );
+	WRITE<int>( reinterpret_cast<std::uintptr_t>(&t.y2), y2 );
+	WRITE<int>( reinterpret_cast<std::uintptr_t>(&t.scale), scale );
+}
+
+bool Terrain::Step()
+{
+	if (taskPtr == 0) return false;
+	Task& t = task[--taskPtr];
+	int x1 = READ<int>( reinterpret_cast<std::uintptr_t>(&t.x1) ), x2 = READ<int>( reinterpret_cast<std::uintptr_t>(&t.x2) );
+	int y1 = READ<int>( reinterpret_cast<std::uintptr_t>(&t.y1) ), y2 = READ<int>( reinterpret_cast<std::uintptr_t>(&t.y2) );
+	Subdivide( x1, y1, x2, y2, READ<int>( reinterpret_cast<std::uintptr_t>(&t.scale) ) );
+	return true;
+}
+
+// -----------------------------------------------------------
+// Recursive subdivision
+// -----------------------------------------------------------
+void Terrain::Subdivide( int x1, int y1, int x2, int y2, int scale )
+{
+	// termination
+	if ((x2 - x1) == 1) return;
+	// calculate diamond vertex positions
+	int cx = (x1 + x2) / 2, cy = (y1 + y2) / 2;
+	// set vertices
+	if (map.Get( cx, y1 ) == 0) map.Set( cx, y1, (map.Get( x1, y1 ) + map.Get( x2, y1 )) / 2 + IRand( scale ) - scale / 2 );
+	if (map.Get( cx, y2 ) == 0) map.Set( cx, y2, (map.Get( x1, y2 ) + map.Get( x2, y2 )) / 2 + IRand( scale ) - scale / 2 );
+	if (map.Get( x1, cy ) == 0) map.Set( x1, cy, (map.Get( x1, y1 ) + map.Get( x1, y2 )) / 2 + IRand( scale ) - scale / 2 );
+	if (map.Get( x2, cy ) == 0) map.Set( x2, cy, (map.Get( x2, y1 ) + map.Get( x2, y2 )) / 2 + IRand( scale ) - scale / 2 );
+	if (map.Get( cx, cy ) == 0) map.Set( cx, cy, (map.Get( x1, y1 ) + map.Get( x2, y2 )) / 2 + IRand( scale ) - scale / 2 );
+	// push new tasks
+	Push( x1, y1, cx, cy, scale / 2 );
+	Push( cx, y1, x2, cy, scale / 2 );
+	Push( x1, cy, cx, y2, scale / 2 );
+	Push( cx, cy, x2, y2, scale / 2 );
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "cache.h"
+
+// Diamond-square terrain generation on a 513x513 height map, the workload this simulator was written for.
+// The map and the task stack are read and written through READ and WRITE, so the game and cachesim
+// run the same accesses through the hierarchy. The heights come from a seeded xorshift generator, so a
+// seed gives the same terrain and the same accesses on every platform.
+
+#define TERRAINSEED 0x2545f491 // seed of the terrain the game shows, any nonzero value
+
+struct Task
+{
+	int x1, y1, x2, y2, scale;
+};
+
+class Map
+{
+public:
+	Map()
+	{
+		int size = 513 * 513;
+		if (size % LINESIZE > 0) // pad to multiple of LINESIZE
+		{
+			size -= size % LINESIZE;
+			size += LINESIZE;
+		}
+		map = new int[size];
+	}
+	void Clear();
+	int Get( int x, int y );
+	void Set( int x, int y, int v );
+	// host copy kept up to date by Set, read without going through the simulator
+	int GetRaw( int x, int y ) const { return map[x + y * 513]; }
+	const int* GetRawRow( int y ) const { return map + y * 513; }
+private:
+	int* map;
+};
+
+class Terrain
+{
+public:
+	Map map;
+	// place the map and task stack at fixed simulated addresses, set the corners, push the first task
+	// and register the map and task stack as regions
+	void Init( std::uint32_t seed = TERRAINSEED );
+	// execute one subdivision task, false when none are left
+	bool Step();
+	int Pending() const { return taskPtr; }
+private:
+	Task task[512];
+	int taskPtr = 0;
+	std::uint32_t state = TERRAINSEED;
+	int IRand( int range );
+	void Push( int x1, int y1, int x2, int y2, int scale );
+	void Subdivide( int x1, int y1, int x2, int y2, int scale );
+};
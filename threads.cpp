@@ -60,96 +60,6 @@ void Thread::SetName( char* _Name )
 	if (::IsDebuggerPresent()) RaiseException( 0x406D1388, 0, sizeof( info ) / sizeof( ULONG_PTR ), (ULONG_PTR*)&info );
 }
 
-DWORD JobThreadProc( LPVOID lpParameter )
-{
-	JobThread* JobThreadInstance = (JobThread*) lpParameter;
-	JobThreadInstance->BackgroundTask();
-	return 0;
-}
-
-void JobThread::CreateAndStartThread( unsigned int threadId )
-{
-	m_GoSignal = CreateEvent( 0, FALSE, FALSE, 0 );
-	m_ThreadHandle = CreateThread( 0, 0, (LPTHREAD_START_ROUTINE) &JobThreadProc, (LPVOID) this, 0, 0 );
-	m_ThreadID = threadId;
-}
-void JobThread::BackgroundTask()
-{
-	while (1)
-	{
-		WaitForSingleObject( m_GoSignal, INFINITE );
-		while (1)
-		{
-			Job* job = JobManager::GetJobManager()->GetNextJob();
-			if (!job) 
-			{
-				JobManager::GetJobManager()->ThreadDone( m_ThreadID );
-				break;
-			}
-			job->RunCodeWrapper();
-		}
-	}
-}
-
-void JobThread::Go()
-{
-	SetEvent( m_GoSignal );
-}
-
-void Job::RunCodeWrapper()
-{
-	Main();
-}
-JobManager* JobManager::m_JobManager = 0;
-
-JobManager::JobManager( unsigned int threads ) : m_NumThreads( threads )
-{
-	InitializeCriticalSection( &m_CS );
-}
-
-JobManager::~JobManager()
-{
-	DeleteCriticalSection( &m_CS );
-}
-
-void JobManager::CreateJobManager( unsigned int numThreads )
-{
-	m_JobManager = new JobManager( numThreads );
-	m_JobManager->m_JobThreadList = new JobThread[numThreads];
-	for ( unsigned int i = 0 ; i < numThreads; i++ ) 
-	{
-		m_JobManager->m_JobThreadList[i].CreateAndStartThread( i );
-		m_JobManager->m_ThreadDone[i] = CreateEvent( 0, FALSE, FALSE, 0 );
-	}
-	m_JobManager->m_JobCount = 0;
-}
-
-void JobManager::AddJob2( Job* a_Job )
-{
-	m_JobList[m_JobCount++] = a_Job;
-}
-
-Job* JobManager::GetNextJob()
-{
-	Job* job = 0;
-	EnterCriticalSection( &m_CS );
-	if (m_JobCount > 0) job = m_JobList[--m_JobCount];
-	LeaveCriticalSection( &m_CS );
-	return job;
-}
-
-void JobManager::RunJobs()
-{
-	for ( unsigned int i = 0; i < m_NumThreads; i++ ) 
-	{
-		m_JobThreadList[i].Go();
-	}
-	WaitForMultipleObjects( m_NumThreads, m_ThreadDone, TRUE, INFINITE );
-}
-
-void JobManager::ThreadDone( unsigned int n ) 
-{ 
-	SetEvent( m_ThreadDone[n] ); 
-}
+// Job and JobManager are in jobs.cpp
 
 // EOF
\ No newline at end of file
@@ -0,0 +1,376 @@
+#pragma once
+#include <cstdlib>
+#include <vector>
+#include <unordered_set>
+#include "cache.h"
+
+// Based on Intel Core i7 4770K (Haswell): 64 entry 4-way dTLB for 4K pages, 32 entry 4-way for 2M
+// pages and a 4 entry 1G TLB, backed by a 1024 entry 8-way STLB shared by 4K and 2M pages
+#define STLBLATENCY 7
+
+enum PageSize { PAGE4K = 12, PAGE2M = 21, PAGE1G = 30 }; // number of bits in the page offset
+
+// how the mapper picks physical frames for newly touched virtual pages
+enum MappingPolicy
+{
+	MAPCONTIGUOUS, // next free frame, like a freshly booted machine
+	MAPRANDOM, // uniformly random free frame, like a long running machine
+	MAPCOLORED // 4K frames keep the cache color (low page number bits) of the virtual page
+};
+
+struct TLBEntry
+{
+	std::uintptr_t vpn; // virtual page number
+	std::uintptr_t frame; // physical address of the page
+	int pageBits;
+	bool valid;
+};
+
+template<std::uint32_t size, std::uint32_t assoc>
+class TLB
+{
+public:
+	TLB()
+	{
+		for (std::uint32_t i = 0; i < size; ++i)
+		{
+			trees[i] = PLRUtree(assoc);
+			for (std::uint32_t j = 0; j < assoc; ++j)
+				entries[i][j].valid = false;
+		}
+	}
+
+	// find the entry translating address for pages of pageBits, nullptr on a miss
+	TLBEntry* Find(std::uintptr_t address, int pageBits)
+	{
+		std::uintptr_t vpn = address >> pageBits;
+		std::uintptr_t index = vpn & (size - 1);
+		TLBEntry* row = entries[index];
+		for (std::uint32_t i = 0; i < assoc; ++i)
+			if (row[i].valid && row[i].vpn == vpn && row[i].pageBits == pageBits)
+			{
+				trees[index].setPath(i);
+				return &row[i];
+			}
+
+		return nullptr;
+	}
+
+	void Insert(const TLBEntry& entry)
+	{
+		std::uintptr_t index = entry.vpn & (size - 1);
+		TLBEntry* row = entries[index];
+		int slot = -1;
+		for (std::uint32_t i = 0; i < assoc && slot == -1; ++i)
+			if (!row[i].valid)
+				slot = (int)i;
+		if (slot == -1)
+			slot = trees[index].getOverwriteTarget();
+
+		row[slot] = entry;
+		trees[index].setPath(slot);
+	}
+
+private:
+	TLBEntry entries[size][assoc];
+	PLRUtree trees[size];
+};
+
+// hands out physical frames for virtual pages
+class AddressMapper
+{
+public:
+	AddressMapper(MappingPolicy policy = MAPCONTIGUOUS, int physicalBits = 34, int colors = 32, std::uint32_t seed = 1)
+		: policy(policy), physicalBits(physicalBits), colors(colors), seed(seed)
+	{
+		// 4K frames come from the lower half of physical memory, 2M frames from the next quarter
+		// and 1G frames from the top quarter so page sizes never overlap
+		std::uint64_t quarter = std::uint64_t(1) << (physicalBits - 2);
+		regionStart[0] = 0, regionSize[0] = 2 * quarter;
+		regionStart[1] = 2 * quarter, regionSize[1] = quarter;
+		regionStart[2] = 3 * quarter, regionSize[2] = quarter;
+		for (int i = 0; i < 3; ++i)
+			next[i] = 0;
+		nextColor.resize(colors, 0);
+		tables = 0;
+	}
+
+	// Back [start, start + bytes) with pages of the given size, the range is widened to page boundaries.
+	// Only before the first page is mapped, as the page table would keep the entries of the old size:
+	// returns false afterwards.
+	bool SetPageSize(const void* start, std::size_t bytes, PageSize pageSize)
+	{
+		if (mapped)
+		{
+			std::cerr << "SetPageSize after the first page was mapped, ignored" << std::endl;
+			return false;
+		}
+
+		std::uintptr_t mask = (std::uintptr_t(1) << pageSize) - 1;
+		Region r;
+		r.start = reinterpret_cast<std::uintptr_t>(start) & ~mask;
+		r.end = (reinterpret_cast<std::uintptr_t>(start) + bytes + mask) & ~mask;
+		r.pageBits = pageSize;
+		regions.push_back(r);
+		return true;
+	}
+
+	int PageBits(std::uintptr_t address) const
+	{
+		for (const Region& r : regions)
+			if (address >= r.start && address < r.end)
+				return r.pageBits;
+
+		return PAGE4K;
+	}
+
+	// physical address of a new frame for the page of pageBits containing address
+	std::uint64_t Allocate(std::uintptr_t address, int pageBits)
+	{
+		mapped = true;
+		int r = pageBits == PAGE4K ? 0 : pageBits == PAGE2M ? 1 : 2;
+		std::uint64_t frames = regionSize[r] >> pageBits;
+		std::uint64_t frame;
+		if (policy == MAPRANDOM)
+		{
+			if (used[r].size() == frames) // no free frame would ever come up
+			{
+				std::cerr << "Out of physical frames for " << (1 << (pageBits - 10)) << "KB pages, raise physicalBits" << std::endl;
+				std::abort();
+			}
+			do
+				frame = Random() % frames;
+			while (!used[r].insert(frame).second);
+		}
+		else if (policy == MAPCOLORED && pageBits == PAGE4K)
+		{
+			int color = (address >> PAGE4K) & (colors - 1);
+			frame = nextColor[color]++ * colors + color;
+		}
+		else
+			frame = next[r]++;
+
+		return regionStart[r] + ((frame % frames) << pageBits);
+	}
+
+	// physical address of a new page table frame, taken from the top of the 4K region down
+	std::uint64_t AllocateTable()
+	{
+		std::uint64_t frame = (regionSize[0] >> PAGE4K) - ++tables;
+		used[0].insert(frame);
+		return regionStart[0] + (frame << PAGE4K);
+	}
+
+private:
+	struct Region
+	{
+		std::uintptr_t start, end;
+		int pageBits;
+	};
+
+	MappingPolicy policy;
+	int physicalBits, colors;
+	std::uint32_t seed;
+	std::vector<Region> regions;
+	std::uint64_t regionStart[3], regionSize[3], next[3], tables;
+	std::vector<std::uint64_t> nextColor; // frames handed out per color
+	std::unordered_set<std::uint64_t> used[3];
+	bool mapped = false; // a page was handed out, page sizes are fixed from then on
+
+	// xorshift, so mappings are the same in every run
+	std::uint32_t Random()
+	{
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		return seed;
+	}
+};
+
+// Translates addresses through the TLBs and walks a 4-level x86-64 page table on an STLB miss.
+// Page table entries are read through the simulated data caches, starting at the first level passed in.
+class MMU
+{
+public:
+	std::uint64_t accesses = 0, dtlbmisses = 0, stlbhits = 0, walks = 0, walkCycles = 0, walkReads = 0;
+	std::vector<std::uint64_t> walkFills; // lines brought into each cache level by page walks
+	AddressMapper mapper;
+
+	// levels lists the cache the walker reads from and everything below it, their latency prices the walk
+	MMU(CacheBase** levels, int nrOfLevels, AddressMapper m = AddressMapper())
+		: walkFills(nrOfLevels, 0), mapper(m), levels(levels, levels + nrOfLevels)
+	{
+		root = NewNode();
+	}
+
+	~MMU() { Free(root, 0); }
+
+	// get the physical address for address, simulating the TLBs and page walks it takes.
+	// If not detailed the TLBs and caches are only warmed, nothing is counted.
+	template<bool detailed = true>
+	std::uintptr_t Translate(std::uintptr_t address)
+	{
+		if (detailed)
+			accesses++;
+
+		// the first level TLBs are probed in parallel for all page sizes
+		TLBEntry* entry = dtlb4k.Find(address, PAGE4K);
+		if (entry == nullptr) entry = dtlb2m.Find(address, PAGE2M);
+		if (entry == nullptr) entry = dtlb1g.Find(address, PAGE1G);
+		if (entry != nullptr)
+			return entry->frame + (address & ((std::uintptr_t(1) << entry->pageBits) - 1));
+
+		if (detailed)
+			dtlbmisses++;
+		TLBEntry e;
+		entry = stlb.Find(address, PAGE4K);
+		if (entry == nullptr) entry = stlb.Find(address, PAGE2M);
+		if (entry != nullptr)
+		{
+			if (detailed)
+			{
+				stlbhits++;
+				walkCycles += STLBLATENCY;
+			}
+			e = *entry;
+		}
+		else
+		{
+			e = Walk(address, detailed, true);
+			if (e.pageBits != PAGE1G) // 1G translations are not cached in the STLB
+				stlb.Insert(e);
+		}
+
+		if (e.pageBits == PAGE4K) dtlb4k.Insert(e);
+		else if (e.pageBits == PAGE2M) dtlb2m.Insert(e);
+		else dtlb1g.Insert(e);
+
+		return e.frame + (address & ((std::uintptr_t(1) << e.pageBits) - 1));
+	}
+
+	// get the physical address for address from the page table alone, leaving TLBs and caches untouched
+	std::uintptr_t Lookup(std::uintptr_t address)
+	{
+		TLBEntry e = Walk(address, false, false);
+		return e.frame + (address & ((std::uintptr_t(1) << e.pageBits) - 1));
+	}
+
+	void ResetStats()
+	{
+		accesses = dtlbmisses = stlbhits = walks = walkCycles = walkReads = 0;
+		walkFills.assign(walkFills.size(), 0);
+	}
+
+	void PrintStats()
+	{
+		std::cout << "Translations: " << accesses << std::endl;
+		std::cout << "dTLB misses: " << dtlbmisses << std::endl;
+		std::cout << "STLB hits: " << stlbhits << std::endl;
+		std::cout << "Page walks: " << walks << " (" << walkReads << " page table reads)" << std::endl;
+		std::cout << "Walk cycles: " << walkCycles << " (" << walkCycles / CYCLESPERMILLISECOND << "ms)" << std::endl;
+		std::cout << "Walk fills per level:";
+		for (std::uint64_t fills : walkFills)
+			std::cout << " " << fills;
+		std::cout << std::endl;
+	}
+
+private:
+	// host copy of a page table page, the walker reads its entries through the caches at frame
+	struct PageTableNode
+	{
+		std::uint64_t frame; // physical address of the page
+		std::uint64_t entries[512]; // bit 0 is present and bit 7 marks a large page
+		PageTableNode* children[512];
+
+		PageTableNode()
+		{
+			for (int i = 0; i < 512; ++i)
+			{
+				entries[i] = 0;
+				children[i] = nullptr;
+			}
+		}
+	};
+
+	TLB<16, 4> dtlb4k;
+	TLB<8, 4> dtlb2m;
+	TLB<1, 4> dtlb1g;
+	TLB<128, 8> stlb;
+	std::vector<CacheBase*> levels;
+	PageTableNode* root;
+
+	// walk the page table for address, mapping the page first if it was never touched.
+	// Entries are read through the caches if simulated, and counted if detailed.
+	TLBEntry Walk(std::uintptr_t address, bool detailed, bool simulated)
+	{
+		if (detailed)
+			walks++;
+		std::vector<std::uint64_t> dirtyBefore(levels.size());
+		for (std::size_t i = 0; detailed && i < levels.size(); ++i)
+			dirtyBefore[i] = levels[i]->dirtyevicts;
+
+		int pageBits = mapper.PageBits(address);
+		PageTableNode* node = root;
+		TLBEntry e;
+		for (int shift = 39;; shift -= 9)
+		{
+			int index = (address >> shift) & 511;
+			if (detailed)
+			{
+				CacheBase::MissDepth() = 0;
+				levels[0]->ReadData(node->frame + index * sizeof(std::uint64_t));
+				walkReads++;
+				// the entry is read from every level down to the first that has it, and filled into the
+				// levels above that
+				int depth = CacheBase::MissDepth();
+				std::size_t missed = depth > 0 ? depth - levels[0]->depth + 1 : 0;
+				for (std::size_t i = 0; i <= missed && i < levels.size(); ++i)
+					walkCycles += levels[i]->latency;
+				for (std::size_t i = 0; i < missed && i < levels.size(); ++i)
+					walkFills[i]++;
+			}
+			else if (simulated)
+				levels[0]->WarmData(node->frame + index * sizeof(std::uint64_t));
+
+			if (shift == pageBits)
+			{
+				if (node->entries[index] == 0)
+					node->entries[index] = mapper.Allocate(address, pageBits) | (shift != PAGE4K ? 0x81 : 0x1);
+
+				e.vpn = address >> pageBits;
+				e.frame = node->entries[index] & ~std::uint64_t(0xfff);
+				e.pageBits = pageBits;
+				e.valid = true;
+				break;
+			}
+
+			if (node->children[index] == nullptr)
+			{
+				node->children[index] = NewNode();
+				node->entries[index] = node->children[index]->frame | 0x1;
+			}
+			node = node->children[index];
+		}
+
+		// the dirty lines the fills evicted are written to the level below
+		for (std::size_t i = 0; detailed && i + 1 < levels.size(); ++i)
+			walkCycles += (levels[i]->dirtyevicts - dirtyBefore[i]) * levels[i + 1]->latency;
+		return e;
+	}
+
+	PageTableNode* NewNode()
+	{
+		PageTableNode* node = new PageTableNode();
+		node->frame = mapper.AllocateTable();
+		return node;
+	}
+
+	void Free(PageTableNode* node, int depth)
+	{
+		if (depth < 3)
+			for (int i = 0; i < 512; ++i)
+				if (node->children[i] != nullptr)
+					Free(node->children[i], depth + 1);
+		delete node;
+	}
+};
@@ -0,0 +1,104 @@
+#pragma once
+#include <stdint.h>
+#include <cstdint>
+#include <stdio.h>
+#include <string.h>
+
+#define TRACEMAGIC "CSTRACE1"
+#define TRACEBUFFER 65536 // records per read or write call to the file
+
+// one memory access as seen by the first cache level
+struct TraceRecord
+{
+	std::uint64_t address;
+	std::uint32_t size; // bytes accessed, never crossing a line
+	std::uint32_t write; // 1 for writes, 0 for reads
+};
+
+// appends accesses to a binary trace file: an 8 byte magic followed by TraceRecords
+class TraceWriter
+{
+public:
+	TraceWriter(const char* file)
+	{
+		f = fopen(file, "wb");
+		if (f != nullptr)
+			fwrite(TRACEMAGIC, 1, 8, f);
+	}
+
+	~TraceWriter() { Close(); }
+
+	bool IsOpen() const { return f != nullptr; }
+
+	void Write(std::uint64_t address, std::uint32_t size, bool write)
+	{
+		if (f == nullptr)
+			return;
+
+		TraceRecord& r = buffer[count++];
+		r.address = address, r.size = size, r.write = write ? 1 : 0;
+		if (count == TRACEBUFFER)
+			Flush();
+	}
+
+	void Close()
+	{
+		if (f == nullptr)
+			return;
+
+		Flush();
+		fclose(f);
+		f = nullptr;
+	}
+
+private:
+	FILE* f;
+	TraceRecord buffer[TRACEBUFFER];
+	int count = 0;
+
+	void Flush()
+	{
+		fwrite(buffer, sizeof(TraceRecord), count, f);
+		count = 0;
+	}
+};
+
+class TraceReader
+{
+public:
+	TraceReader(const char* file)
+	{
+		f = fopen(file, "rb");
+		char magic[8];
+		if (f != nullptr && (fread(magic, 1, 8, f) != 8 || memcmp(magic, TRACEMAGIC, 8) != 0))
+		{
+			fclose(f);
+			f = nullptr;
+		}
+	}
+
+	~TraceReader()
+	{
+		if (f != nullptr)
+			fclose(f);
+	}
+
+	bool IsOpen() const { return f != nullptr; }
+
+	// read up to max records, returns the number read, 0 at the end of the trace
+	int Read(TraceRecord* records, int max)
+	{
+		if (f == nullptr)
+			return 0;
+		return (int)fread(records, sizeof(TraceRecord), max, f);
+	}
+
+	void Rewind()
+	{
+		if (f != nullptr)
+			fseek(f, 8, SEEK_SET);
+	}
+
+private:
+	FILE* f;
+};